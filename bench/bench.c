@@ -0,0 +1,582 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include "xmalloc.h"
+#include "matrix.h"
+#include "reader.h"
+#include "solver.h"
+#include "lockstep.h"
+
+/* Benchmarks for Cdoku. The corpora are generated from a fixed seed and
+ * written out as ordinary puzzle files, then read back and solved one
+ * puzzle at a time, timing each one; the 9x9 corpora are also solved in
+ * batches with the lockstep solver, to compare. The microbenchmarks time
+ * the hot parts of the solver on their own. Everything is reported as JSON
+ * on stdout, so the results of two builds can be compared. */
+
+/* every allocation goes through these, thanks to the linker's --wrap, so
+ * that the allocations made per puzzle can be counted */
+unsigned long allocations = 0;
+void *__real_malloc(size_t sz);
+void *__real_realloc(void *old, size_t sz);
+void *__real_calloc(size_t n, size_t sz);
+
+void *__wrap_malloc(size_t sz) {
+   allocations++;
+   return __real_malloc(sz);
+}
+
+void *__wrap_realloc(void *old, size_t sz) {
+   allocations++;
+   return __real_realloc(old, sz);
+}
+
+void *__wrap_calloc(size_t n, size_t sz) {
+   allocations++;
+   return __real_calloc(n, sz);
+}
+
+/* matrix internals timed by the microbenchmarks */
+dlx_index get_col(matrix *m);
+void cover_col(matrix *m, dlx_index c);
+void uncover_col(matrix *m, dlx_index c);
+
+/* some of the 17-clue puzzles from Gordon Royle's collection; the 17-clue
+ * corpus is made of random transformations of these */
+const char *seventeen[] = {
+   "000000010400000000020000000000050407008000300001090000300400200050100000000806000",
+   "000000010400000000020000000000050604008000300001090000300400200050100000000807000",
+   "000000012000035000000600070700000300000400800100000000000120000080000040050000600",
+   "000000012003600000000007000410020000000500300700000600280000040000300500000000000",
+   "000000012008030000000000040120500000000004700060000000507000300000620000000100000",
+   "000000013000030080070000000000206000030000900000010000600500204000400700100000000",
+   "000000013000200000000000080000760200008000400010000000200000750600340000000008000"
+};
+
+/* the kinds of corpus */
+typedef enum kind {
+   KIND_EASY,       /* unique solution, 36 clues */
+   KIND_HARD,       /* minimal: no clue can be removed and stay unique */
+   KIND_SEVENTEEN,  /* unique solution, 17 clues */
+   KIND_UNSOLVABLE, /* a minimal puzzle with one wrong but legal clue */
+   KIND_LARGE       /* 16x16 with 120 clues */
+} kind;
+
+/* a corpus to generate and time */
+typedef struct corpus {
+   const char *name;
+   kind what;
+   int k;
+   unsigned div; /* fraction of the puzzle count it gets */
+} corpus;
+
+const corpus corpora[] = {
+   { "easy", KIND_EASY, 3, 1 },
+   { "hard", KIND_HARD, 3, 4 },
+   { "17-clue", KIND_SEVENTEEN, 3, 1 },
+   { "unsolvable", KIND_UNSOLVABLE, 3, 4 },
+   { "16x16", KIND_LARGE, 4, 10 }
+};
+
+#define CORPORA (sizeof(corpora)/sizeof(corpora[0]))
+
+/* keeps the microbenchmark loops from being optimized away */
+volatile unsigned long sink;
+
+/* the time in seconds on a clock that only goes forward */
+double now(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* a random number below range, from the same generator the solver uses */
+unsigned rnd(unsigned long *seed, unsigned range) {
+   *seed = *seed * 1103515245UL + 12345UL;
+   return (*seed >> 16) % range;
+}
+
+/* fills p with a random permutation of 0 to len-1 */
+void permutation(unsigned long *seed, int *p, int len) {
+   int i;
+   for (i = 0; i < len; i++)
+      p[i] = i;
+   for (i = len - 1; i > 0; i--) {
+      const int j = rnd(seed, i + 1), t = p[i];
+      p[i] = p[j];
+      p[j] = t;
+   }
+}
+
+/* fills p with a random permutation of 0 to k*k-1 that keeps each group of
+ * k together, such as the rows of a band */
+void band_permutation(unsigned long *seed, int *p, int k) {
+   int bands[MAX_K], inner[MAX_K], b, i;
+
+   permutation(seed, bands, k);
+   for (b = 0; b < k; b++) {
+      permutation(seed, inner, k);
+      for (i = 0; i < k; i++)
+         p[b*k + i] = bands[b]*k + inner[i];
+   }
+}
+
+/* applies a random validity-preserving transformation to a grid: the values
+ * are relabeled, rows and columns are shuffled within their bands and
+ * stacks, the bands and stacks are shuffled, and the grid may be
+ * transposed. Empty cells stay empty. */
+void transform(unsigned long *seed, int k, uint8_t *grid) {
+   const int n = k*k;
+   int rows[MAX_K*MAX_K], cols[MAX_K*MAX_K], label[MAX_K*MAX_K];
+   uint8_t old[MAX_CELLS];
+   int x, y;
+
+   const int flip = rnd(seed, 2);
+   band_permutation(seed, rows, k);
+   band_permutation(seed, cols, k);
+   permutation(seed, label, n);
+
+   memcpy(old, grid, n*n);
+   for (y = 0; y < n; y++) {
+      for (x = 0; x < n; x++) {
+         const int v = flip ? old[cols[x]*n + rows[y]]
+                            : old[rows[y]*n + cols[x]];
+         grid[y*n + x] = v ? label[v-1] + 1 : 0;
+      }
+   }
+}
+
+/* fills grid with a random solved grid */
+void full_grid(unsigned long *seed, int k, uint8_t *grid) {
+   const int n = k*k;
+   int x, y;
+
+   /* a valid pattern, which the transformation scrambles */
+   for (y = 0; y < n; y++)
+      for (x = 0; x < n; x++)
+         grid[y*n + x] = (k*(y%k) + y/k + x) % n + 1;
+   transform(seed, k, grid);
+}
+
+/* whether a puzzle has exactly one solution */
+int unique(solver *s, const uint8_t *grid) {
+   return solver_enumerate(s, grid, 2, NULL, NULL) == 1;
+}
+
+/* empties the cells of a grid in a random order, keeping the solution
+ * unique, until only clues are left or no more can be emptied */
+void remove_clues(unsigned long *seed, solver *s, int k, uint8_t *grid,
+      int clues) {
+   const int n = k*k;
+   int order[MAX_CELLS];
+   int i, left = n*n;
+
+   permutation(seed, order, n*n);
+   for (i = 0; i < n*n && left > clues; i++) {
+      const int cell = order[i], v = grid[cell];
+      grid[cell] = 0;
+      if (unique(s, grid))
+         left--;
+      else
+         grid[cell] = v;
+   }
+}
+
+/* makes a minimal puzzle unsolvable by filling one of its empty cells with
+ * a value that none of its row, column, or box holds but which isn't the
+ * value from the solution; every solution of the new puzzle would also
+ * solve the old one, so there can't be any */
+void spoil(unsigned long *seed, solver *s, int k, uint8_t *grid) {
+   const int n = k*k;
+   uint8_t soln[MAX_CELLS];
+   int cell, v, i;
+
+   solver_solve(s, grid, soln);
+   for (;;) {
+      cell = rnd(seed, n*n);
+      if (grid[cell])
+         continue;
+
+      const int x = cell%n, y = cell/n;
+      const int bx = x/k*k, by = y/k*k;
+      int used[MAX_K*MAX_K+1] = { 0 };
+      for (i = 0; i < n; i++) {
+         used[grid[y*n + i]] = 1;
+         used[grid[i*n + x]] = 1;
+         used[grid[(by + i/k)*n + bx + i%k]] = 1;
+      }
+
+      /* try the values from a random starting point */
+      const int start = rnd(seed, n);
+      for (i = 0; i < n; i++) {
+         v = (start + i) % n + 1;
+         if (!used[v] && v != soln[cell]) {
+            grid[cell] = v;
+            return;
+         }
+      }
+   }
+}
+
+/* generates puzzle number i of a corpus */
+void generate(const corpus *c, unsigned long *seed, solver *s, unsigned i,
+      uint8_t *grid) {
+   const int n = c->k*c->k;
+   int j;
+
+   switch (c->what) {
+   case KIND_EASY:
+      full_grid(seed, c->k, grid);
+      remove_clues(seed, s, c->k, grid, 36);
+      break;
+   case KIND_HARD:
+   case KIND_UNSOLVABLE:
+      full_grid(seed, c->k, grid);
+      remove_clues(seed, s, c->k, grid, 0);
+      if (c->what == KIND_UNSOLVABLE)
+         spoil(seed, s, c->k, grid);
+      break;
+   case KIND_SEVENTEEN:
+      for (j = 0; j < n*n; j++)
+         grid[j] = seventeen[i % (sizeof(seventeen)/sizeof(seventeen[0]))][j]
+               - '0';
+      transform(seed, c->k, grid);
+      break;
+   case KIND_LARGE:
+      /* random blanks, so the puzzle is solvable but may not be unique */
+      full_grid(seed, c->k, grid);
+      {
+         int order[MAX_CELLS];
+         permutation(seed, order, n*n);
+         for (j = 0; j < n*n - 120; j++)
+            grid[order[j]] = 0;
+      }
+      break;
+   }
+}
+
+/* writes a corpus of count puzzles to a file, one per line; returns 0 if
+ * the file can't be written */
+int write_corpus(const corpus *c, unsigned long seed, unsigned count,
+      const char *name) {
+   const char *digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+   const int n = c->k*c->k;
+   solver *s = xcheck(new_solver(c->k));
+   uint8_t grid[MAX_CELLS];
+   char line[MAX_CELLS+1];
+   unsigned i;
+   int j;
+
+   FILE *f = fopen(name, "w");
+   if (!f) {
+      free_solver(s);
+      return 0;
+   }
+
+   for (i = 0; i < count; i++) {
+      generate(c, &seed, s, i, grid);
+      for (j = 0; j < n*n; j++)
+         line[j] = grid[j] ? digits[grid[j]] : '.';
+      line[n*n] = '\n';
+      fwrite(line, 1, n*n + 1, f);
+   }
+
+   free_solver(s);
+   return !fclose(f);
+}
+
+/* compares latencies for qsort */
+int by_time(const void *a, const void *b) {
+   const double x = *(const double *)a, y = *(const double *)b;
+   return x < y ? -1 : x > y;
+}
+
+/* reads a corpus back and solves it in batches of LOCKSTEP_LANES with the
+ * lockstep solver, handing the puzzles singles can't finish to the DLX
+ * solver, and prints the rate and how many were finished by singles as
+ * JSON fields; returns 0 if it can't be read */
+int time_lockstep(const corpus *c, const char *name, unsigned count) {
+   solver *s = xcheck(new_solver(c->k));
+   uint8_t cells[LOCKSTEP_LANES][MAX_CELLS], soln[LOCKSTEP_LANES][MAX_CELLS];
+   const uint8_t *puzzles[LOCKSTEP_LANES];
+   uint8_t *solns[LOCKSTEP_LANES];
+   lockstep_result results[LOCKSTEP_LANES];
+   unsigned solved = 0, singles = 0, done = 0;
+   const char *line;
+   size_t len;
+   int i, n;
+
+   reader *r = open_reader(name);
+   if (!r) {
+      free_solver(s);
+      return 0;
+   }
+   for (i = 0; i < LOCKSTEP_LANES; i++)
+      solns[i] = soln[i];
+
+   const double start = now();
+   for (;;) {
+      for (n = 0; n < LOCKSTEP_LANES && done + n < count &&
+            (line = reader_line(r, &len)); n++)
+         puzzles[n] = parse_puzzle(c->k, line, len, cells[n]) ? cells[n]
+                                                             : NULL;
+      if (!n)
+         break;
+
+      lockstep_solve(n, puzzles, solns, results);
+      for (i = 0; i < n; i++) {
+         if (results[i] == LOCKSTEP_SOLVED) {
+            singles++;
+            solved++;
+         } else if (results[i] == LOCKSTEP_STUCK && puzzles[i] &&
+               solver_solve(s, puzzles[i], soln[i]) == SOLVE_FOUND)
+            solved++;
+      }
+      done += n;
+   }
+   const double total = now() - start;
+
+   close_reader(r);
+   printf("     \"lockstep_puzzles_per_sec\": %.1f,\n",
+         total > 0 ? done / total : 0);
+   printf("     \"lockstep_solved\": %u, \"singles\": %u,\n", solved, singles);
+
+   free_solver(s);
+   return 1;
+}
+
+/* reads a corpus back and solves it one puzzle at a time, timing each, and
+ * prints its results as a JSON object; returns 0 if it can't be read */
+int time_corpus(const corpus *c, const char *name, unsigned count, int last) {
+   double *lat = xmalloc(count * sizeof(double));
+   solver *s = xcheck(new_solver(c->k));
+   uint8_t grid[MAX_CELLS], soln[MAX_CELLS];
+   unsigned solved = 0, done = 0;
+   const char *line;
+   size_t len;
+
+   reader *r = open_reader(name);
+   if (!r) {
+      free(lat);
+      free_solver(s);
+      return 0;
+   }
+
+   /* everything from here on is what solving a file costs per puzzle */
+   const unsigned long allocs = allocations;
+   const double start = now();
+   while (done < count && (line = reader_line(r, &len))) {
+      const double t = now();
+      if (parse_puzzle(c->k, line, len, grid) &&
+            solver_solve(s, grid, soln) == SOLVE_FOUND)
+         solved++;
+      lat[done++] = now() - t;
+   }
+   const double total = now() - start;
+   const double per_alloc = done ? (double)(allocations - allocs) / done
+                                 : 0;
+
+   close_reader(r);
+   qsort(lat, done, sizeof(double), by_time);
+
+   printf("    {\"name\": \"%s\", \"k\": %d, \"puzzles\": %u, "
+         "\"solved\": %u,\n", c->name, c->k, done, solved);
+   printf("     \"seconds\": %.6f, \"puzzles_per_sec\": %.1f,\n", total,
+         total > 0 ? done / total : 0);
+   printf("     \"p50_us\": %.3f, \"p99_us\": %.3f, \"max_us\": %.3f,\n",
+         done ? lat[done/2] * 1e6 : 0, done ? lat[done*99/100] * 1e6 : 0,
+         done ? lat[done-1] * 1e6 : 0);
+   if (c->k == 3 && !time_lockstep(c, name, count)) {
+      free(lat);
+      free_solver(s);
+      return 0;
+   }
+   printf("     \"allocs_per_puzzle\": %.3f}%s\n", per_alloc, last ? "" : ",");
+
+   free(lat);
+   free_solver(s);
+   return 1;
+}
+
+/* builds the DLX matrix for boards of order k the way the solver does,
+ * with a row for every value of every cell */
+matrix *build_matrix(int k) {
+   const int n = k*k, x_off = n*n;
+   matrix *m = xcheck(new_matrix(4*x_off));
+   unsigned data[4];
+   int x, y, v;
+
+   matrix_reserve(m, n*n*n, 4*n*n*n);
+   for (x = 0; x < n; x++) {
+      for (y = 0; y < n; y++) {
+         for (v = 0; v < n; v++) {
+            const int b = k*(y/k) + x/k;
+            data[0] = n*y + x;
+            data[1] = x_off + n*x + v;
+            data[2] = 2*x_off + n*y + v;
+            data[3] = 3*x_off + n*b + v;
+            matrix_add_row(m, data, 4);
+         }
+      }
+   }
+
+   return m;
+}
+
+/* prints the result of a microbenchmark as a JSON object */
+void report_micro(const char *name, unsigned long ops, double secs,
+      int last) {
+   printf("    {\"name\": \"%s\", \"ops\": %lu, \"seconds\": %.6f, "
+         "\"ns_per_op\": %.3f}%s\n", name, ops, secs,
+         ops ? secs * 1e9 / ops : 0, last ? "" : ",");
+}
+
+/* times the parts of the solver on their own, using the 9x9 matrix and the
+ * easy corpus */
+void micro(const char *easy) {
+   const int k = 3, n = 9, w = 4*n*n;
+   unsigned long ops;
+   uint8_t grid[MAX_CELLS];
+   const char *line;
+   size_t len;
+   double t;
+   int i, c;
+
+   /* building the matrix, per row added */
+   t = now();
+   for (i = 0; i < 200; i++)
+      free_matrix(build_matrix(k));
+   report_micro("matrix_add_row", 200UL*n*n*n, now() - t, 0);
+
+   /* covering and uncovering each column of the full matrix */
+   matrix *m = build_matrix(k);
+   t = now();
+   for (i = 0; i < 2000; i++) {
+      for (c = 1; c <= w; c++) {
+         cover_col(m, c);
+         uncover_col(m, c);
+      }
+   }
+   report_micro("cover_col/uncover_col", 2000UL*w, now() - t, 0);
+
+   /* picking a column once the givens of an easy puzzle are selected */
+   reader *r = open_reader(easy);
+   if (r && (line = reader_line(r, &len)) && parse_puzzle(k, line, len, grid))
+      for (i = 0; i < n*n; i++)
+         if (grid[i])
+            matrix_select_row(m, ((i%n)*n + i/n)*n + grid[i] - 1);
+   if (r)
+      close_reader(r);
+   t = now();
+   for (i = 0; i < 1000000; i++)
+      sink += get_col(m);
+   report_micro("get_col", 1000000UL, now() - t, 0);
+   free_matrix(m);
+
+   /* reading and parsing the easy corpus, per puzzle */
+   ops = 0;
+   t = now();
+   for (i = 0; i < 20; i++) {
+      if (!(r = open_reader(easy)))
+         break;
+      while ((line = reader_line(r, &len))) {
+         sink += parse_puzzle(k, line, len, grid);
+         ops++;
+      }
+      close_reader(r);
+   }
+   report_micro("next_puzzle", ops, now() - t, 1);
+}
+
+void usage(char *prog) {
+   printf("cdoku-bench - benchmarks for Cdoku\n");
+   printf("usage: %s [--seed N] [--count N] [dir]\n", prog);
+   printf("   --seed N    seed for the generated corpora (default 1)\n");
+   printf("   --count N   puzzles in the easy and 17-clue corpora; the others\n");
+   printf("               get a quarter, or a tenth for 16x16 (default 1000)\n");
+   printf("   dir         where the corpora are written (default .)\n");
+}
+
+int main(int argc, char **argv) {
+   unsigned long seed = 1;
+   unsigned count = 1000;
+   const char *dir = ".";
+   char name[4096], easy[4096];
+   unsigned i;
+   int a;
+
+   for (a = 1; a < argc; a++) {
+      if (!strcmp(argv[a], "--seed") && a+1 < argc) {
+         seed = strtoul(argv[++a], NULL, 10);
+      } else if (!strcmp(argv[a], "--count") && a+1 < argc) {
+         count = strtoul(argv[++a], NULL, 10);
+      } else if (argv[a][0] != '-') {
+         dir = argv[a];
+      } else {
+         usage(argv[0]);
+         return 1;
+      }
+   }
+
+   if (mkdir(dir, 0777) && errno != EEXIST) {
+      fprintf(stderr, "Couldn't create directory: %s\n", dir);
+      return 1;
+   }
+
+   printf("{\n  \"seed\": %lu,\n  \"corpora\": [\n", seed);
+   for (i = 0; i < CORPORA; i++) {
+      const corpus *c = &corpora[i];
+      const unsigned num = count / c->div ? count / c->div : 1;
+
+      sprintf(name, "%.4000s/%s.txt", dir, c->name);
+      if (i == 0)
+         strcpy(easy, name);
+
+      /* each corpus gets its own seed, so its puzzles don't depend on the
+       * sizes of the others */
+      if (!write_corpus(c, seed + i, num, name) ||
+            !time_corpus(c, name, num, i + 1 == CORPORA)) {
+         fprintf(stderr, "Couldn't write corpus: %s\n", name);
+         return 1;
+      }
+   }
+   printf("  ],\n  \"micro\": [\n");
+   micro(easy);
+   printf("  ]\n}\n");
+
+   return 0;
+}
@@ -0,0 +1,232 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "xmalloc.h"
+#include "reader.h"
+#include "solver.h"
+#include "report.h"
+#include "lockstep.h"
+#include "batch.h"
+
+/* number of puzzles handed out at a time, per worker */
+#define CHUNK_PER_JOB 256
+
+/* a puzzle waiting to be solved, and the report for it */
+typedef struct slot {
+   uint8_t *puzzle; /* NULL if the line was the wrong length */
+   uint8_t *cells;
+   char *out;
+   unsigned len;
+   search_stats stats;
+} slot;
+
+/* state shared between the reading thread and the workers */
+typedef struct pool {
+   pthread_mutex_t lock;
+   pthread_cond_t work; /* signalled when a chunk is ready */
+   pthread_cond_t done; /* signalled when a chunk is finished */
+   slot *slots;
+   unsigned first;      /* number of the puzzle in the first slot */
+   unsigned count;      /* number of slots in the current chunk */
+   unsigned next;       /* next slot to hand out */
+   unsigned finished;   /* number of slots finished */
+   int quit;
+   options *opt;
+} pool;
+
+/* solves count slots from first together with the lockstep solver, which
+ * hands the ones it can't finish on to s */
+void solve_slots(pool *p, unsigned first, unsigned count, solver *s) {
+   uint8_t soln[LOCKSTEP_LANES][MAX_CELLS];
+   const uint8_t *puzzles[LOCKSTEP_LANES];
+   uint8_t *solns[LOCKSTEP_LANES];
+   lockstep_result results[LOCKSTEP_LANES];
+   unsigned i;
+
+   for (i = 0; i < count; i++) {
+      puzzles[i] = p->slots[first + i].puzzle;
+      solns[i] = soln[i];
+   }
+   lockstep_solve(count, puzzles, solns, results);
+
+   for (i = 0; i < count; i++) {
+      slot *sl = &p->slots[first + i];
+      sl->len = report_lockstep(sl->out, p->first + first + i, sl->puzzle,
+            results[i], soln[i], s, p->opt,
+            p->opt->stats ? &sl->stats : NULL);
+   }
+}
+
+/* worker thread: solves puzzles from the current chunk with its own solver
+ * until told to quit */
+void *worker(void *arg) {
+   pool *p = arg;
+   solver *s = xcheck(new_solver(p->opt->k));
+   const int lockstep = lockstep_usable(p->opt);
+
+   pthread_mutex_lock(&p->lock);
+   for (;;) {
+      /* wait for a slot to be available */
+      while (!p->quit && p->next == p->count)
+         pthread_cond_wait(&p->work, &p->lock);
+      if (p->quit)
+         break;
+
+      /* claim the slot, or a batch of them for the lockstep solver, and
+       * solve them without holding the lock */
+      const unsigned i = p->next;
+      const unsigned take = lockstep && p->count - i > LOCKSTEP_LANES
+            ? LOCKSTEP_LANES : lockstep ? p->count - i : 1;
+      p->next += take;
+      pthread_mutex_unlock(&p->lock);
+
+      if (lockstep)
+         solve_slots(p, i, take, s);
+      else
+         p->slots[i].len = report_puzzle(p->slots[i].out, p->first + i,
+               p->slots[i].puzzle, s, p->opt,
+               p->opt->stats ? &p->slots[i].stats : NULL);
+
+      pthread_mutex_lock(&p->lock);
+      p->finished += take;
+      if (p->finished == p->count)
+         pthread_cond_signal(&p->done);
+   }
+   pthread_mutex_unlock(&p->lock);
+
+   free_solver(s);
+   return NULL;
+}
+
+/* solves all the puzzles in a file on opt->jobs worker threads; puzzles are
+ * read and handed out in chunks, and each chunk's reports are written in
+ * order once it is finished, so the output is the same as solving the file
+ * one puzzle at a time. Chunks are no bigger than opt->flush puzzles, so a
+ * stream's results come out in batches of that many. With opt->stats, each
+ * puzzle's effort is added to total. */
+void solve_parallel(reader *file, options *opt, writer *out,
+      search_stats *total) {
+   const unsigned size = opt->flush > 0 &&
+         (unsigned)opt->flush < opt->jobs * CHUNK_PER_JOB ?
+         (unsigned)opt->flush : opt->jobs * CHUNK_PER_JOB;
+   const unsigned slot_size = report_size(opt->k);
+   const unsigned cells = opt->k*opt->k*opt->k*opt->k;
+   pthread_t *threads = xmalloc(opt->jobs * sizeof(pthread_t));
+   pool p;
+   unsigned i, n = 0;
+   int j, jobs = 0;
+
+   /* every slot's buffers are allocated up front and reused for each
+    * chunk */
+   p.slots = xmalloc(size * sizeof(slot));
+   for (i = 0; i < size; i++) {
+      p.slots[i].out = xmalloc(slot_size);
+      p.slots[i].cells = xmalloc(cells);
+   }
+   p.count = p.next = p.finished = 0;
+   p.quit = 0;
+   p.opt = opt;
+   pthread_mutex_init(&p.lock, NULL);
+   pthread_cond_init(&p.work, NULL);
+   pthread_cond_init(&p.done, NULL);
+
+   /* start the workers; if we can't start any, the loop below never hands
+    * out work, so fall back on doing it ourselves */
+   for (j = 0; j < opt->jobs; j++)
+      if (!pthread_create(&threads[jobs], NULL, worker, &p))
+         jobs++;
+
+   solver *s = jobs ? NULL : xcheck(new_solver(opt->k));
+
+   for (;;) {
+      /* fill a chunk with puzzles until the file ends */
+      unsigned count = 0;
+      int got;
+      while (count < size &&
+            (got = reader_puzzle(file, opt->k, p.slots[count].cells)) >= 0) {
+         slot *sl = &p.slots[count++];
+         sl->puzzle = got ? sl->cells : NULL;
+      }
+      if (!count)
+         break;
+
+      if (jobs) {
+         /* hand the chunk to the workers and wait for them to finish it */
+         pthread_mutex_lock(&p.lock);
+         p.first = n + 1;
+         p.count = count;
+         p.next = p.finished = 0;
+         pthread_cond_broadcast(&p.work);
+         while (p.finished < p.count)
+            pthread_cond_wait(&p.done, &p.lock);
+         pthread_mutex_unlock(&p.lock);
+      } else {
+         for (i = 0; i < count; i++)
+            p.slots[i].len = report_puzzle(p.slots[i].out, n + 1 + i,
+                  p.slots[i].puzzle, s, opt,
+                  opt->stats ? &p.slots[i].stats : NULL);
+      }
+
+      /* write the reports out in order */
+      for (i = 0; i < count; i++) {
+         writer_write(out, p.slots[i].out, p.slots[i].len);
+         if (opt->stats)
+            report_tally(total, &p.slots[i].stats, n + 1 + i, opt);
+      }
+      n += count;
+
+      /* pass the results on in batches */
+      if (opt->flush && n / opt->flush != (n - count) / opt->flush)
+         writer_flush(out);
+   }
+
+   /* tell the workers to quit and wait for them */
+   pthread_mutex_lock(&p.lock);
+   p.quit = 1;
+   pthread_cond_broadcast(&p.work);
+   pthread_mutex_unlock(&p.lock);
+   for (j = 0; j < jobs; j++)
+      pthread_join(threads[j], NULL);
+
+   if (s)
+      free_solver(s);
+   pthread_mutex_destroy(&p.lock);
+   pthread_cond_destroy(&p.work);
+   pthread_cond_destroy(&p.done);
+   for (i = 0; i < size; i++) {
+      free(p.slots[i].out);
+      free(p.slots[i].cells);
+   }
+   free(p.slots);
+   free(threads);
+}
@@ -26,15 +26,15 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#ifndef STACK_H_GUARD
-#define STACK_H_GUARD
 
-typedef struct stack_node stack_node;
-typedef struct stack stack;
+#ifndef BATCH_H_GUARD
+#define BATCH_H_GUARD
 
-stack *new_stack(void);
-void free_stack(stack *s);
-void stack_push(stack *s, void *item);
-void *stack_pop(stack *s);
+#include "options.h"
+#include "reader.h"
+#include "output.h"
+
+void solve_parallel(reader *file, options *opt, writer *out,
+      search_stats *total);
 
 #endif
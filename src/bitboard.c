@@ -0,0 +1,374 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "bitboard.h"
+
+/* A backtracking solver for 9x9 boards that keeps a 9-bit mask of the
+ * remaining candidates for every cell. It fills naked and hidden singles
+ * until it has to guess, then branches on the empty cell with the fewest
+ * candidates, which is found a block of 8 cells
+ * at a time; on x86 the blocks are scanned with SSE4.1 or AVX2 when the CPU
+ * has them, counting bits with a nibble lookup table and picking the
+ * minimum with PHMINPOSUW. Every kernel makes the same choices, so the
+ * result doesn't depend on the CPU. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BB_X86
+#include <immintrin.h>
+#endif
+
+#define BB_N 9
+#define BB_CELLS 81
+#define BB_PAD 96 /* cells rounded up to a whole number of 16-cell blocks */
+#define BB_ALL 0x1ff
+
+/* the state of a board partway through the search */
+typedef struct board {
+   uint16_t cand[BB_PAD]; /* candidates of each cell, 0 once it's filled */
+   uint16_t fill[BB_PAD]; /* 0xffff for filled cells and padding, else 0 */
+   uint8_t val[BB_CELLS]; /* value of each filled cell */
+   int left;              /* number of empty cells */
+} board;
+
+/* picks the empty cell to branch on, storing its candidate count */
+typedef int (*bb_pick)(const board *b, unsigned *count);
+
+/* counts the bits in a candidate mask */
+unsigned bb_popcount(unsigned x) {
+#ifdef __GNUC__
+   return __builtin_popcount(x);
+#else
+   unsigned c = 0;
+   for (; x; x &= x - 1)
+      c++;
+   return c;
+#endif
+}
+
+/* scans blocks of 8 cells, choosing the first cell with the fewest
+ * candidates in the first block with the lowest minimum; stops early at a
+ * block containing a cell with 0 or 1 candidates, since nothing beats that */
+int pick_scalar(const board *b, unsigned *count) {
+   unsigned best = 0xffff;
+   int cell = 0, i, j;
+
+   for (i = 0; i < BB_PAD; i += 8) {
+      unsigned min = 0xffff;
+      int at = 0;
+
+      for (j = 0; j < 8; j++) {
+         const unsigned key = bb_popcount(b->cand[i+j]) | b->fill[i+j];
+         if (key < min) {
+            min = key;
+            at = j;
+         }
+      }
+
+      if (min < best) {
+         best = min;
+         cell = i + at;
+         if (best <= 1)
+            break;
+      }
+   }
+
+   *count = best;
+   return cell;
+}
+
+#ifdef BB_X86
+/* pick_scalar using SSE4.1, 8 cells at a time */
+__attribute__((target("sse4.1")))
+int pick_sse41(const board *b, unsigned *count) {
+   const __m128i lut = _mm_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+   const __m128i nib = _mm_set1_epi8(0x0f), lo8 = _mm_set1_epi16(0xff);
+   unsigned best = 0xffff;
+   int cell = 0, i;
+
+   for (i = 0; i < BB_PAD; i += 8) {
+      const __m128i v = _mm_loadu_si128((const __m128i*)(b->cand + i));
+
+      /* count bits per byte, then add the bytes of each cell together */
+      __m128i pc = _mm_add_epi8(_mm_shuffle_epi8(lut, _mm_and_si128(v, nib)),
+            _mm_shuffle_epi8(lut, _mm_and_si128(_mm_srli_epi16(v, 4), nib)));
+      pc = _mm_add_epi16(_mm_and_si128(pc, lo8), _mm_srli_epi16(pc, 8));
+
+      /* filled cells never win; the lowest index wins ties */
+      const __m128i key = _mm_or_si128(pc,
+            _mm_loadu_si128((const __m128i*)(b->fill + i)));
+      const __m128i mp = _mm_minpos_epu16(key);
+      const unsigned min = _mm_extract_epi16(mp, 0);
+
+      if (min < best) {
+         best = min;
+         cell = i + _mm_extract_epi16(mp, 1);
+         if (best <= 1)
+            break;
+      }
+   }
+
+   *count = best;
+   return cell;
+}
+
+/* pick_scalar using AVX2, counting bits 16 cells at a time */
+__attribute__((target("avx2")))
+int pick_avx2(const board *b, unsigned *count) {
+   const __m256i lut = _mm256_setr_epi8(0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+         0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+   const __m256i nib = _mm256_set1_epi8(0x0f), lo8 = _mm256_set1_epi16(0xff);
+   unsigned best = 0xffff;
+   int cell = 0, i, h;
+
+   for (i = 0; i < BB_PAD; i += 16) {
+      const __m256i v = _mm256_loadu_si256((const __m256i*)(b->cand + i));
+
+      __m256i pc = _mm256_add_epi8(
+            _mm256_shuffle_epi8(lut, _mm256_and_si256(v, nib)),
+            _mm256_shuffle_epi8(lut,
+               _mm256_and_si256(_mm256_srli_epi16(v, 4), nib)));
+      pc = _mm256_add_epi16(_mm256_and_si256(pc, lo8),
+            _mm256_srli_epi16(pc, 8));
+
+      const __m256i key = _mm256_or_si256(pc,
+            _mm256_loadu_si256((const __m256i*)(b->fill + i)));
+
+      /* take the minimum of each half in order, like pick_scalar */
+      for (h = 0; h < 2; h++) {
+         const __m128i mp = _mm_minpos_epu16(h ? _mm256_extracti128_si256(key, 1)
+                                               : _mm256_castsi256_si128(key));
+         const unsigned min = _mm_extract_epi16(mp, 0);
+
+         if (min < best) {
+            best = min;
+            cell = i + 8*h + _mm_extract_epi16(mp, 1);
+            if (best <= 1) {
+               *count = best;
+               return cell;
+            }
+         }
+      }
+   }
+
+   *count = best;
+   return cell;
+}
+#endif
+
+/* the kernel for this CPU and its name, chosen once by choose_pick */
+bb_pick bb_chosen;
+const char *bb_chosen_name;
+pthread_once_t bb_once = PTHREAD_ONCE_INIT;
+
+/* chooses the fastest kernel the CPU supports */
+void choose_pick(void) {
+#ifdef BB_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx2")) {
+      bb_chosen_name = "avx2";
+      bb_chosen = pick_avx2;
+      return;
+   }
+   if (__builtin_cpu_supports("sse4.1")) {
+      bb_chosen_name = "sse4.1";
+      bb_chosen = pick_sse41;
+      return;
+   }
+#endif
+
+   bb_chosen_name = "scalar";
+   bb_chosen = pick_scalar;
+}
+
+/* returns the kernel for this CPU, storing its name unless name is NULL;
+ * the CPU is only looked at the first time */
+bb_pick get_pick(const char **name) {
+   pthread_once(&bb_once, choose_pick);
+   if (name)
+      *name = bb_chosen_name;
+   return bb_chosen;
+}
+
+/* names the kernel bitboard_solve uses on this CPU */
+const char *bitboard_kernel(void) {
+   const char *name;
+   get_pick(&name);
+   return name;
+}
+
+/* fills a cell, removing its value from the candidates of every cell that
+ * shares its row, column, or box; returns 0 if the value isn't a candidate */
+int bb_place(board *b, int cell, unsigned bit) {
+   const int x = cell % BB_N, y = cell / BB_N;
+   const int bx = x - x%3, by = y - y%3;
+   const uint16_t keep = ~bit;
+   int i, v = 0;
+
+   if (!(b->cand[cell] & bit))
+      return 0;
+
+   while (!(bit >> v & 1))
+      v++;
+   b->val[cell] = v;
+   b->cand[cell] = 0;
+   b->fill[cell] = 0xffff;
+   b->left--;
+
+   for (i = 0; i < BB_N; i++) {
+      b->cand[y*BB_N + i] &= keep;
+      b->cand[i*BB_N + x] &= keep;
+      b->cand[(by + i/3)*BB_N + bx + i%3] &= keep;
+   }
+
+   return 1;
+}
+
+/* finds cell i of unit u, where units 0-8 are rows, 9-17 are columns, and
+ * 18-26 are boxes */
+int bb_unit_cell(int u, int i) {
+   if (u < 9)
+      return u*BB_N + i;
+   if (u < 18)
+      return i*BB_N + u - 9;
+   u -= 18;
+   return (u/3*3 + i/3)*BB_N + u%3*3 + i%3;
+}
+
+/* looks for a value that only one cell of some row, column, or box can
+ * take, and fills that cell; returns 1 if it filled one, 0 if there were
+ * none, and -1 if some value can't go anywhere in a unit */
+int bb_hidden(board *b) {
+   int u, i;
+
+   for (u = 0; u < 27; u++) {
+      unsigned once = 0, twice = 0, placed = 0;
+
+      for (i = 0; i < BB_N; i++) {
+         const int cell = bb_unit_cell(u, i);
+         const unsigned c = b->cand[cell];
+         twice |= once & c;
+         once |= c;
+         if (b->fill[cell])
+            placed |= 1u << b->val[cell];
+      }
+
+      if ((once | placed) != BB_ALL)
+         return -1;
+
+      once &= ~twice;
+      if (once) {
+         const unsigned bit = once & -once;
+         for (i = 0; !(b->cand[bb_unit_cell(u, i)] & bit); i++);
+         bb_place(b, bb_unit_cell(u, i), bit);
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/* solves the board in place, returning 0 if it can't be solved */
+int bb_search(board *b, bb_pick pick) {
+   unsigned count;
+   int cell;
+
+   /* fill forced cells in place, until we have to guess */
+   for (;;) {
+      if (!b->left)
+         return 1;
+
+      cell = pick(b, &count);
+      if (!count)
+         return 0;
+
+      if (count == 1) {
+         /* naked single: the cell has one candidate left */
+         bb_place(b, cell, b->cand[cell]);
+      } else {
+         /* hidden single: a value has one cell left in some unit */
+         const int h = bb_hidden(b);
+         if (h < 0)
+            return 0;
+         if (!h)
+            break;
+      }
+   }
+
+   /* try each candidate of the cell on a copy of the board */
+   unsigned c = b->cand[cell];
+   while (c) {
+      const unsigned bit = c & -c;
+      board next = *b;
+      c ^= bit;
+
+      bb_place(&next, cell, bit);
+      if (bb_search(&next, pick)) {
+         *b = next;
+         return 1;
+      }
+   }
+
+   return 0;
+}
+
+/* solves a 9x9 Sudoku grid with the same contract as solve(): vals holds
+ * the cells in row-major order with 0 for empty cells, and the solution is
+ * written into out, which may be vals. Returns 0 if there is no solution. */
+int bitboard_solve(int k, const uint8_t *vals, uint8_t *out) {
+   board b;
+   int i;
+
+   if (k != 3)
+      return 0;
+
+   for (i = 0; i < BB_PAD; i++) {
+      b.cand[i] = i < BB_CELLS ? BB_ALL : 0;
+      b.fill[i] = i < BB_CELLS ? 0 : 0xffff;
+   }
+   b.left = BB_CELLS;
+
+   /* place the givens; conflicting givens mean there's no solution */
+   for (i = 0; i < BB_CELLS; i++)
+      if (0 < vals[i] && vals[i] <= BB_N &&
+            !bb_place(&b, i, 1u << (vals[i] - 1)))
+         return 0;
+
+   if (!bb_search(&b, get_pick(NULL)))
+      return 0;
+
+   for (i = 0; i < BB_CELLS; i++)
+      out[i] = b.val[i] + 1;
+
+   return 1;
+}
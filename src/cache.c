@@ -0,0 +1,676 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "xmalloc.h"
+#include "cache.h"
+
+/* entries per set; a new entry replaces the least recently used one in its
+ * set once the set is full */
+#define WAYS 4
+
+/* most steps spent looking for a canonical form; puzzles with very few
+ * clues tie under so many symmetries that they aren't worth caching */
+#define CANON_BUDGET 10000
+
+/* most search nodes spent showing that a puzzle a cache file calls
+ * unsolvable really is; one that takes longer is left out */
+#define PROOF_NODES 100000
+
+/* orders of CACHE_K things */
+#define MAX_PERMS 6
+
+/* first line of a cache file */
+#define CACHE_MAGIC "cdoku cache 1\n"
+
+/* a solved puzzle, either in canonical form or exactly as it was given */
+typedef struct entry {
+   unsigned long used; /* when the entry was last used, 0 if it's empty */
+   uint32_t hash;
+   uint8_t k;
+   uint8_t exact;      /* keyed on the puzzle as given, not canonical */
+   uint8_t status;
+   uint8_t puzzle[CACHE_CELLS];
+   uint8_t solution[CACHE_CELLS];
+} entry;
+
+struct cache {
+   pthread_mutex_t lock;
+   entry *entries;
+   unsigned long sets;
+   unsigned long clock;       /* counts uses, for finding the oldest entry */
+   cache_stats stats;
+   int perms[CACHE_K+1];      /* number of orders of k things */
+   uint8_t order[CACHE_K+1][MAX_PERMS][CACHE_K]; /* and the orders */
+};
+
+/* state of the search for a puzzle's canonical form. The columns are kept
+ * in blocks of columns that the rows placed so far can't tell apart, so
+ * the order within a block is only chosen once a row needs it to be. */
+typedef struct canon_search {
+   const cache *c;
+   int k, n;
+   unsigned long steps;
+   uint8_t grid[CACHE_CELLS];   /* the puzzle, possibly transposed */
+   uint8_t where[CACHE_CELLS];  /* puzzle cell of each grid cell */
+   uint8_t cols[CACHE_N];       /* column order so far */
+   unsigned blocks;             /* bit p is set if a block starts at p */
+   int rows[CACHE_N];           /* row order so far */
+   unsigned used;               /* rows in the order so far */
+   int best_rows;               /* rows of best that have been found */
+   cache_key *best;
+} canon_search;
+
+/* a run of columns holding values the form hasn't labelled yet; each order
+ * of the run gives the values different labels */
+typedef struct new_run {
+   int at, len;
+} new_run;
+
+/* lists the orders of k things, returning how many there are */
+int permutations(int k, uint8_t perms[MAX_PERMS][CACHE_K]) {
+   int count = 1, i, j, s;
+
+   /* each order of i things gives i+1 orders of i+1 things, by swapping the
+    * new one into each place */
+   for (i = 0; i < k; i++)
+      perms[0][i] = i;
+   for (i = 1; i < k; i++) {
+      const int have = count;
+      for (j = 0; j < have; j++) {
+         for (s = 0; s < i; s++) {
+            memcpy(perms[count], perms[j], CACHE_K);
+            perms[count][i] = perms[j][s];
+            perms[count][s] = i;
+            count++;
+         }
+      }
+   }
+   return count;
+}
+
+/* creates a cache holding as many entries as fit in the given number of
+ * bytes */
+cache *new_cache(size_t bytes) {
+   cache *c = xmalloc(sizeof(cache));
+   int k;
+
+   c->sets = bytes / (WAYS*sizeof(entry));
+   if (!c->sets)
+      c->sets = 1;
+   c->entries = xcheck(calloc(c->sets*WAYS, sizeof(entry)));
+   c->clock = 0;
+   memset(&c->stats, 0, sizeof(cache_stats));
+   c->stats.capacity = c->sets*WAYS;
+   pthread_mutex_init(&c->lock, NULL);
+
+   for (k = 1; k <= CACHE_K; k++)
+      c->perms[k] = permutations(k, c->order[k]);
+   return c;
+}
+
+void free_cache(cache *c) {
+   pthread_mutex_destroy(&c->lock);
+   free(c->entries);
+   free(c);
+}
+
+/* records the form just completed, and how it was reached */
+void canon_found(canon_search *cs, const uint8_t *label, int next) {
+   const int n = cs->n;
+   int r, c, v;
+   cache_key *key = cs->best;
+
+   for (r = 0; r < n; r++)
+      for (c = 0; c < n; c++)
+         key->src[r*n + c] = cs->where[cs->rows[r]*n + cs->cols[c]];
+
+   /* values missing from the puzzle take the labels left over */
+   memcpy(key->label, label, n+1);
+   for (v = 1; v <= n; v++)
+      if (!key->label[v])
+         key->label[v] = ++next;
+   key->unlabel[0] = 0;
+   for (v = 1; v <= n; v++)
+      key->unlabel[key->label[v]] = v;
+}
+
+void canon_rows(canon_search *cs, int r, const uint8_t *label, int next);
+
+/* tries each order of the runs of new values from run g on, labelling the
+ * new values in the order they end up in, then moves on to the next row */
+void canon_order(canon_search *cs, int r, uint8_t *cols, unsigned blocks,
+      const new_run *runs, int nruns, int g, const uint8_t *label,
+      int next) {
+   const int n = cs->n;
+   const uint8_t *row = cs->grid + cs->rows[r]*n;
+   int p, j;
+
+   if (g == nruns) {
+      uint8_t lab[CACHE_N+1], old[CACHE_N];
+      const unsigned old_blocks = cs->blocks;
+
+      memcpy(lab, label, n+1);
+      for (j = 0; j < n; j++)
+         if (row[cols[j]] && !lab[row[cols[j]]])
+            lab[row[cols[j]]] = ++next;
+
+      memcpy(old, cs->cols, n);
+      memcpy(cs->cols, cols, n);
+      cs->blocks = blocks;
+      cs->used |= 1u << cs->rows[r];
+      canon_rows(cs, r+1, lab, next);
+      cs->used &= ~(1u << cs->rows[r]);
+      memcpy(cs->cols, old, n);
+      cs->blocks = old_blocks;
+   } else {
+      const int at = runs[g].at, len = runs[g].len;
+      uint8_t run[CACHE_K];
+
+      memcpy(run, cols + at, len);
+      for (p = 0; p < cs->c->perms[len]; p++) {
+         for (j = 0; j < len; j++)
+            cols[at + j] = run[cs->c->order[len][p][j]];
+         canon_order(cs, r, cols, blocks, runs, nruns, g+1, label, next);
+      }
+      memcpy(cols + at, run, len);
+   }
+}
+
+/* the ways a row can be placed next in the form */
+typedef struct canon_place {
+   int row;                   /* which row of the grid */
+   uint8_t cols[CACHE_N];     /* the columns ordered to suit it */
+   uint8_t form[CACHE_N];     /* how it looks in the form */
+   unsigned blocks;
+   new_run runs[CACHE_N];
+   int nruns;
+} canon_place;
+
+/* orders the columns of each block to make a row as small as it can be:
+ * empty cells first, then values that have labels, from the smallest up,
+ * then new values, which are labelled in the order they're met */
+void canon_place_row(canon_search *cs, const uint8_t *label, int next,
+      canon_place *pl) {
+   const int n = cs->n;
+   const uint8_t *g = cs->grid + pl->row*n;
+   uint8_t *cols = pl->cols;
+   int a, b, c, j, z, m;
+
+   pl->blocks = 0;
+   pl->nruns = 0;
+   for (a = 0; a < n; a = b) {
+      for (b = a+1; b < n && !(cs->blocks >> b & 1); b++)
+         ;
+
+      /* empty cells stay a block, everything else is told apart */
+      for (z = a, c = a; c < b; c++)
+         if (!g[cs->cols[c]])
+            cols[z++] = cs->cols[c];
+      for (m = z, c = a; c < b; c++) {
+         const int v = g[cs->cols[c]];
+         if (v && label[v]) {
+            for (j = m++; j > z && label[g[cols[j-1]]] > label[v]; j--)
+               cols[j] = cols[j-1];
+            cols[j] = cs->cols[c];
+         }
+      }
+      for (j = m, c = a; c < b; c++)
+         if (g[cs->cols[c]] && !label[g[cs->cols[c]]])
+            cols[j++] = cs->cols[c];
+      if (j - m > 1) {
+         pl->runs[pl->nruns].at = m;
+         pl->runs[pl->nruns++].len = j - m;
+      }
+      pl->blocks |= 1u << a;
+      for (j = z; j < b; j++)
+         pl->blocks |= 1u << j;
+   }
+
+   for (j = 0; j < n; j++) {
+      const int v = g[cols[j]];
+      pl->form[j] = !v ? 0 : label[v] ? label[v] : ++next;
+   }
+}
+
+/* places each row allowed at position r of the form, smallest first, and
+ * carries on with any that don't make the form bigger than the best found
+ * so far */
+void canon_rows(canon_search *cs, int r, const uint8_t *label, int next) {
+   const int k = cs->k, n = cs->n;
+   canon_place place[CACHE_N], *order[CACHE_N];
+   int i, j, first, last, count = 0;
+
+   if (r == n) {
+      canon_found(cs, label, next);
+      return;
+   }
+   if (++cs->steps > CANON_BUDGET)
+      return;
+
+   /* the first row of a band can come from any band not used yet, and the
+    * rest from the same band */
+   if (r % k) {
+      first = cs->rows[r - r%k] / k * k;
+      last = first + k;
+   } else {
+      first = 0;
+      last = n;
+   }
+
+   for (i = first; i < last; i++) {
+      canon_place *pl = &place[count];
+      if (cs->used & (1u << i))
+         continue;
+      if (!(r % k) && (cs->used >> (i/k*k) & ((1u << k) - 1)))
+         continue;
+
+      pl->row = i;
+      canon_place_row(cs, label, next, pl);
+      for (j = count++; j > 0 && memcmp(order[j-1]->form, pl->form, n) > 0;
+            j--)
+         order[j] = order[j-1];
+      order[j] = pl;
+   }
+
+   for (i = 0; i < count; i++) {
+      canon_place *pl = order[i];
+
+      /* anything beats rows that haven't been found yet */
+      const int cmp = r < cs->best_rows
+            ? memcmp(pl->form, cs->best->cells + r*n, n) : -1;
+      if (cmp > 0)
+         break;
+      if (cmp < 0) {
+         memcpy(cs->best->cells + r*n, pl->form, n);
+         cs->best_rows = r+1;
+      }
+
+      cs->rows[r] = pl->row;
+      canon_order(cs, r, pl->cols, pl->blocks, pl->runs, pl->nruns, 0,
+            label, next);
+   }
+}
+
+/* FNV-1a hash of a puzzle */
+uint32_t key_hash(int k, int exact, const uint8_t *cells) {
+   uint32_t h = 2166136261u ^ k ^ exact << 8;
+   int i;
+
+   for (i = 0; i < k*k*k*k; i++)
+      h = (h ^ cells[i]) * 16777619u;
+   return h;
+}
+
+/* the least pattern of clues a row can take as the first row of a form,
+ * read as a binary number with a bit set for each clue: the stacks ordered
+ * from fewest clues to most, with the clues at the end of each */
+unsigned first_row_pattern(int k, const uint8_t *row, int *clues) {
+   unsigned pattern = 0;
+   int s, j, m;
+
+   for (s = 0; s < k; s++)
+      for (clues[s] = 0, j = 0; j < k; j++)
+         clues[s] += row[s*k + j] != 0;
+   for (m = 0; m <= k; m++)
+      for (s = 0; s < k; s++)
+         if (clues[s] == m)
+            pattern = pattern << k | ((1u << m) - 1);
+   return pattern;
+}
+
+/* reduces a puzzle to its canonical form: the least one, read as a string,
+ * over relabelling the values, reordering the rows within each band and the
+ * bands, reordering the columns within each stack and the stacks, and
+ * transposing. Returns 0 if that takes too long to find. */
+int canonical_form(cache *c, int k, const uint8_t *puzzle, cache_key *key) {
+   canon_search cs;
+   canon_place pl;
+   uint8_t label[CACHE_N+1];
+   unsigned least = ~0u, pattern[2][CACHE_N];
+   int clues[2][CACHE_N][CACHE_K];
+   int t, i, p, s, j, x, y;
+
+   cs.c = c;
+   cs.k = k;
+   cs.n = k*k;
+   cs.steps = 0;
+   cs.best_rows = 0;
+   cs.best = key;
+   key->k = k;
+   memset(label, 0, sizeof(label));
+
+   /* the first row of the form has as few clues as it can, as far to the
+    * right as they'll go, so only some rows can start it */
+   for (t = 0; t < 2; t++) {
+      for (i = 0; i < cs.n; i++) {
+         uint8_t row[CACHE_N];
+         for (x = 0; x < cs.n; x++)
+            row[x] = t ? puzzle[x*cs.n + i] : puzzle[i*cs.n + x];
+         pattern[t][i] = first_row_pattern(k, row, clues[t][i]);
+         if (pattern[t][i] < least)
+            least = pattern[t][i];
+      }
+   }
+
+   for (t = 0; t < 2; t++) {
+      for (y = 0; y < cs.n; y++) {
+         for (x = 0; x < cs.n; x++) {
+            const int from = t ? x*cs.n + y : y*cs.n + x;
+            cs.grid[y*cs.n + x] = puzzle[from];
+            cs.where[y*cs.n + x] = from;
+         }
+      }
+
+      for (i = 0; i < cs.n; i++) {
+         const int *cl = clues[t][i];
+         if (pattern[t][i] != least)
+            continue;
+
+         /* start from each order of the stacks that puts fewer clues
+          * first, with a block per stack */
+         for (p = 0; p < c->perms[k]; p++) {
+            const uint8_t *o = c->order[k][p];
+            for (s = 1; s < k && cl[o[s-1]] <= cl[o[s]]; s++)
+               ;
+            if (s < k)
+               continue;
+
+            cs.blocks = 0;
+            for (s = 0; s < k; s++) {
+               cs.blocks |= 1u << s*k;
+               for (j = 0; j < k; j++)
+                  cs.cols[s*k + j] = o[s]*k + j;
+            }
+            cs.used = 0;
+            cs.rows[0] = pl.row = i;
+            canon_place_row(&cs, label, 0, &pl);
+            memcpy(cs.best->cells, pl.form, cs.n);
+            cs.best_rows = cs.best_rows ? cs.best_rows : 1;
+            canon_order(&cs, 0, pl.cols, pl.blocks, pl.runs, pl.nruns, 0,
+                  label, 0);
+         }
+      }
+   }
+
+   key->hash = key_hash(k, 0, key->cells);
+   return cs.steps <= CANON_BUDGET;
+}
+
+/* finds a puzzle's entry, or NULL; the cache must be locked */
+entry *find_entry(cache *c, int k, int exact, uint32_t hash,
+      const uint8_t *cells) {
+   entry *set = c->entries + (hash % c->sets)*WAYS;
+   int i;
+
+   for (i = 0; i < WAYS; i++)
+      if (set[i].used && set[i].hash == hash && set[i].k == k &&
+            set[i].exact == exact && !memcmp(set[i].puzzle, cells, k*k*k*k))
+         return &set[i];
+   return NULL;
+}
+
+/* stores a puzzle's outcome, making room if need be; the cache must be
+ * locked */
+void store_entry(cache *c, int k, int exact, uint32_t hash,
+      const uint8_t *cells, const uint8_t *soln, solve_status st) {
+   entry *e = find_entry(c, k, exact, hash, cells);
+   const int size = k*k*k*k;
+   int i;
+
+   if (!e) {
+      entry *set = c->entries + (hash % c->sets)*WAYS;
+      e = &set[0];
+      for (i = 1; i < WAYS; i++)
+         if (set[i].used < e->used)
+            e = &set[i];
+      if (e->used)
+         c->stats.evictions++;
+      else
+         c->stats.entries++;
+   }
+
+   e->used = ++c->clock;
+   e->hash = hash;
+   e->k = k;
+   e->exact = exact;
+   e->status = st;
+   memcpy(e->puzzle, cells, size);
+   if (st == SOLVE_FOUND)
+      memcpy(e->solution, soln, size);
+   else
+      memset(e->solution, 0, size);
+}
+
+/* looks a puzzle up, first as it was given and then in canonical form,
+ * writing its solution out if it's there; returns 0 if it isn't. key is
+ * filled in for cache_insert either way. */
+int cache_lookup(cache *c, int k, const uint8_t *puzzle, cache_key *key,
+      uint8_t *out, solve_status *st) {
+   const int cells = k*k*k*k;
+   entry *e;
+   int i;
+
+   key->k = k;
+   key->canonical = 0;
+   if (k > CACHE_K) {
+      pthread_mutex_lock(&c->lock);
+      c->stats.skipped++;
+      pthread_mutex_unlock(&c->lock);
+      return 0;
+   }
+
+   /* exact repeats are cheap to find */
+   key->exact_hash = key_hash(k, 1, puzzle);
+   pthread_mutex_lock(&c->lock);
+   c->stats.lookups++;
+   if (e = find_entry(c, k, 1, key->exact_hash, puzzle)) {
+      e->used = ++c->clock;
+      *st = e->status;
+      if (*st == SOLVE_FOUND)
+         memcpy(out, e->solution, cells);
+      c->stats.hits++;
+      c->stats.exact_hits++;
+   }
+   pthread_mutex_unlock(&c->lock);
+   if (e)
+      return 1;
+
+   /* otherwise look for the same puzzle under some symmetry */
+   key->canonical = canonical_form(c, k, puzzle, key);
+   pthread_mutex_lock(&c->lock);
+   if (!key->canonical) {
+      c->stats.skipped++;
+   } else if (e = find_entry(c, k, 0, key->hash, key->cells)) {
+      e->used = ++c->clock;
+      *st = e->status;
+      if (*st == SOLVE_FOUND)
+         for (i = 0; i < cells; i++)
+            out[key->src[i]] = key->unlabel[e->solution[i]];
+      c->stats.hits++;
+
+      /* so the next exact repeat is found straight away */
+      store_entry(c, k, 1, key->exact_hash, puzzle, out, *st);
+   }
+   pthread_mutex_unlock(&c->lock);
+   return e != NULL;
+}
+
+/* stores the outcome of solving a puzzle that cache_lookup didn't find,
+ * both as it was given and in canonical form; searches that gave up aren't
+ * stored, since another try might get further */
+void cache_insert(cache *c, const cache_key *key, const uint8_t *puzzle,
+      const uint8_t *soln, solve_status st) {
+   const int cells = key->k*key->k*key->k*key->k;
+   uint8_t canon[CACHE_CELLS];
+   int i;
+
+   if (st == SOLVE_GAVE_UP || key->k > CACHE_K)
+      return;
+   if (key->canonical && st == SOLVE_FOUND)
+      for (i = 0; i < cells; i++)
+         canon[i] = key->label[soln[key->src[i]]];
+
+   pthread_mutex_lock(&c->lock);
+   store_entry(c, key->k, 1, key->exact_hash, puzzle, soln, st);
+   if (key->canonical)
+      store_entry(c, key->k, 0, key->hash, key->cells, canon, st);
+   pthread_mutex_unlock(&c->lock);
+}
+
+void cache_get_stats(cache *c, cache_stats *st) {
+   pthread_mutex_lock(&c->lock);
+   *st = c->stats;
+   pthread_mutex_unlock(&c->lock);
+}
+
+/* checks that a solution fills the board legally and keeps the puzzle's
+ * clues, so a damaged cache file can't give wrong answers */
+int solution_valid(int k, const uint8_t *puzzle, const uint8_t *soln) {
+   const int n = k*k;
+   unsigned rows[CACHE_N], cols[CACHE_N], boxes[CACHE_N];
+   int x, y;
+
+   memset(rows, 0, sizeof(rows));
+   memset(cols, 0, sizeof(cols));
+   memset(boxes, 0, sizeof(boxes));
+   for (y = 0; y < n; y++) {
+      for (x = 0; x < n; x++) {
+         const int v = soln[y*n + x], b = y/k*k + x/k;
+         unsigned bit;
+         if (!v || v > n || (puzzle[y*n + x] && puzzle[y*n + x] != v))
+            return 0;
+         bit = 1u << v;
+         if ((rows[y] & bit) || (cols[x] & bit) || (boxes[b] & bit))
+            return 0;
+         rows[y] |= bit;
+         cols[x] |= bit;
+         boxes[b] |= bit;
+      }
+   }
+   return 1;
+}
+
+/* reads the entries saved in a cache file into the cache; a file that
+ * doesn't exist yet is left for cache_save to create. Solutions are checked
+ * with solution_valid, and puzzles saved as unsolvable are searched again,
+ * within PROOF_NODES, so a damaged cache file can't turn a puzzle that has
+ * a solution into one that doesn't. Returns 0 if the file couldn't be
+ * read. */
+int cache_load(cache *c, const char *path) {
+   const size_t magic = strlen(CACHE_MAGIC);
+   uint8_t rec[2 + 2*CACHE_CELLS], proof[CACHE_CELLS];
+   solver *solvers[CACHE_K+1] = { NULL };
+   search_limits limits;
+   char head[sizeof(CACHE_MAGIC)];
+   FILE *f;
+   int ok, i;
+
+   if (!(f = fopen(path, "rb")))
+      return 1;
+   ok = fread(head, 1, magic, f) == magic && !memcmp(head, CACHE_MAGIC, magic);
+   limits.nodes = PROOF_NODES;
+   limits.seconds = 0;
+
+   while (ok && fread(rec, sizeof(rec), 1, f) == 1) {
+      const int k = rec[0], st = rec[1];
+      const uint8_t *puzzle = rec + 2, *soln = rec + 2 + CACHE_CELLS;
+
+      /* skip anything that doesn't make sense */
+      if (k < 1 || k > CACHE_K || (st != SOLVE_FOUND && st != SOLVE_NONE))
+         continue;
+      for (i = 0; i < k*k*k*k && puzzle[i] <= k*k; i++)
+         ;
+      if (i < k*k*k*k)
+         continue;
+      if (st == SOLVE_FOUND && !solution_valid(k, puzzle, soln))
+         continue;
+
+      /* or that we can't show is unsolvable */
+      if (st == SOLVE_NONE) {
+         if (!solvers[k] && (solvers[k] = new_solver(k)))
+            solver_set_limits(solvers[k], &limits);
+         if (!solvers[k] ||
+               solver_solve(solvers[k], puzzle, proof) != SOLVE_NONE)
+            continue;
+      }
+
+      pthread_mutex_lock(&c->lock);
+      store_entry(c, k, 0, key_hash(k, 0, puzzle), puzzle, soln, st);
+      pthread_mutex_unlock(&c->lock);
+   }
+
+   for (i = 0; i <= CACHE_K; i++)
+      if (solvers[i])
+         free_solver(solvers[i]);
+   ok = ok && !ferror(f);
+   fclose(f);
+   return ok;
+}
+
+/* writes the canonical entries out to a cache file, replacing it only once
+ * the new one is complete. Returns 0 if the file couldn't be written. */
+int cache_save(cache *c, const char *path) {
+   char *tmp = xmalloc(strlen(path) + 5);
+   uint8_t rec[2 + 2*CACHE_CELLS];
+   unsigned long i;
+   FILE *f;
+   int ok;
+
+   strcpy(tmp, path);
+   strcat(tmp, ".tmp");
+   if (!(f = fopen(tmp, "wb"))) {
+      free(tmp);
+      return 0;
+   }
+   ok = fputs(CACHE_MAGIC, f) >= 0;
+
+   pthread_mutex_lock(&c->lock);
+   for (i = 0; ok && i < c->sets*WAYS; i++) {
+      const entry *e = &c->entries[i];
+      if (!e->used || e->exact)
+         continue;
+      rec[0] = e->k;
+      rec[1] = e->status;
+      memcpy(rec + 2, e->puzzle, CACHE_CELLS);
+      memcpy(rec + 2 + CACHE_CELLS, e->solution, CACHE_CELLS);
+      ok = fwrite(rec, sizeof(rec), 1, f) == 1;
+   }
+   pthread_mutex_unlock(&c->lock);
+
+   ok = !fclose(f) && ok && !rename(tmp, path);
+   if (!ok)
+      remove(tmp);
+   free(tmp);
+   return ok;
+}
@@ -0,0 +1,78 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef CACHE_H_GUARD
+#define CACHE_H_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+#include "solver.h"
+
+/* largest order of board the cache handles; bigger boards have far too many
+ * symmetries to search for their canonical form */
+#define CACHE_K 3
+#define CACHE_N (CACHE_K*CACHE_K)
+#define CACHE_CELLS (CACHE_N*CACHE_N)
+
+typedef struct cache cache;
+
+/* a puzzle reduced to its canonical form, along with the transformation
+ * that maps the puzzle onto it */
+typedef struct cache_key {
+   int k;
+   int canonical;                 /* 0 if the form took too long to find */
+   uint32_t exact_hash;           /* hash of the puzzle as given */
+   uint32_t hash;                 /* and of the canonical puzzle */
+   uint8_t cells[CACHE_CELLS];    /* the canonical puzzle */
+   uint8_t src[CACHE_CELLS];      /* puzzle cell behind each canonical cell */
+   uint8_t label[CACHE_N+1];      /* puzzle value to canonical value */
+   uint8_t unlabel[CACHE_N+1];    /* and back again */
+} cache_key;
+
+/* how well the cache is doing */
+typedef struct cache_stats {
+   unsigned long lookups;    /* puzzles looked up */
+   unsigned long hits;       /* lookups answered from the cache */
+   unsigned long exact_hits; /* ... by a puzzle given the same way */
+   unsigned long skipped;    /* puzzles the cache couldn't handle */
+   unsigned long evictions;  /* entries pushed out to make room */
+   unsigned long entries;    /* entries held now */
+   unsigned long capacity;   /* entries that fit in the memory given */
+} cache_stats;
+
+cache *new_cache(size_t bytes);
+void free_cache(cache *c);
+int cache_lookup(cache *c, int k, const uint8_t *puzzle, cache_key *key,
+      uint8_t *out, solve_status *st);
+void cache_insert(cache *c, const cache_key *key, const uint8_t *puzzle,
+      const uint8_t *soln, solve_status st);
+void cache_get_stats(cache *c, cache_stats *st);
+int cache_load(cache *c, const char *path);
+int cache_save(cache *c, const char *path);
+
+#endif
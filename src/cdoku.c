@@ -0,0 +1,316 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "cdoku.h"
+#include "reader.h"
+#include "solver.h"
+
+struct cdoku {
+   int k;
+   int cells;
+   solver *s;
+};
+
+struct cdoku_session {
+   int n;
+   int cells;
+   solver *s;          /* holds the placed values as selected rows */
+   uint8_t *grid;      /* the values placed so far, givens included */
+   uint8_t *given;     /* nonzero for the puzzle's own cells */
+   int *moves;         /* the filled cells, in the order they were selected */
+   int count;
+   uint8_t *solution;  /* the grid the last search completed */
+   int searched;       /* whether outcome is still current */
+   cdoku_status outcome;
+};
+
+cdoku_status cdoku_create(cdoku **ctx, int k) {
+   cdoku *c = NULL;
+
+   if (!ctx)
+      return CDOKU_ERR_ARGS;
+   *ctx = NULL;
+   if (k < 1 || k > MAX_K)
+      return CDOKU_ERR_ARGS;
+
+   if (!(c = malloc(sizeof(cdoku))))
+      return CDOKU_ERR_NOMEM;
+   if (!(c->s = new_solver(k))) {
+      free(c);
+      return CDOKU_ERR_NOMEM;
+   }
+   c->k = k;
+   c->cells = k*k*k*k;
+
+   *ctx = c;
+   return CDOKU_SOLVED;
+}
+
+void cdoku_destroy(cdoku *ctx) {
+   if (ctx) {
+      free_solver(ctx->s);
+      free(ctx);
+   }
+}
+
+void cdoku_set_limits(cdoku *ctx, unsigned long nodes, double seconds) {
+   search_limits limits;
+
+   if (!ctx)
+      return;
+   limits.nodes = nodes;
+   limits.seconds = seconds > 0 ? seconds : 0;
+   solver_set_limits(ctx->s, &limits);
+}
+
+/* checks that every cell of a puzzle is empty or holds a value in range */
+int cells_valid(const cdoku *ctx, const uint8_t *puzzle) {
+   const int n = ctx->k*ctx->k;
+   int i;
+
+   for (i = 0; i < ctx->cells; i++)
+      if (puzzle[i] > n)
+         return 0;
+   return 1;
+}
+
+/* translates the outcome of a search into a status code */
+cdoku_status to_status(solve_status st) {
+   switch (st) {
+   case SOLVE_FOUND:
+      return CDOKU_SOLVED;
+   case SOLVE_GAVE_UP:
+      return CDOKU_GAVE_UP;
+   default:
+      return CDOKU_NO_SOLUTION;
+   }
+}
+
+cdoku_status cdoku_solve(cdoku *ctx, const uint8_t *puzzle,
+      uint8_t *solution) {
+   if (!ctx || !puzzle || !solution || !cells_valid(ctx, puzzle))
+      return CDOKU_ERR_ARGS;
+
+   return to_status(solver_solve(ctx->s, puzzle, solution));
+}
+
+int cdoku_solve_batch(cdoku *ctx, const uint8_t *puzzles,
+      uint8_t *solutions, size_t count, cdoku_status *results) {
+   size_t i;
+   int solved = 0;
+
+   if (!ctx || (count && (!puzzles || !solutions || !results)))
+      return CDOKU_ERR_ARGS;
+
+   for (i = 0; i < count; i++) {
+      const size_t at = i*ctx->cells;
+      results[i] = cdoku_solve(ctx, puzzles + at, solutions + at);
+      if (results[i] == CDOKU_SOLVED)
+         solved++;
+   }
+   return solved;
+}
+
+/* selects the row for a value in a cell of a session's grid; returns 0 if
+ * it clashes with a value already there */
+int session_select(cdoku_session *g, int cell, int value) {
+   if (!solver_select(g->s, cell%g->n, cell/g->n, value - 1))
+      return 0;
+   g->grid[cell] = value;
+   g->moves[g->count++] = cell;
+   g->searched = 0;
+   return 1;
+}
+
+/* searches for a completion of a session's grid, unless no move has been
+ * made since the last search */
+cdoku_status session_search(cdoku_session *g) {
+   if (!g->searched) {
+      g->outcome = to_status(solver_search(g->s, g->solution));
+      g->searched = 1;
+   }
+   return g->outcome;
+}
+
+cdoku_status cdoku_session_create(cdoku_session **session, int k,
+      const uint8_t *puzzle) {
+   cdoku_session *g = NULL;
+   int i;
+
+   if (!session)
+      return CDOKU_ERR_ARGS;
+   *session = NULL;
+   if (k < 1 || k > MAX_K || !puzzle)
+      return CDOKU_ERR_ARGS;
+
+   if (!(g = calloc(1, sizeof(cdoku_session))))
+      return CDOKU_ERR_NOMEM;
+   g->n = k*k;
+   g->cells = g->n*g->n;
+   g->s = new_solver(k);
+   g->grid = calloc(g->cells, 1);
+   g->given = malloc(g->cells);
+   g->moves = malloc(g->cells*sizeof(int));
+   g->solution = malloc(g->cells);
+   if (!g->s || !g->grid || !g->given || !g->moves || !g->solution) {
+      cdoku_session_destroy(g);
+      return CDOKU_ERR_NOMEM;
+   }
+
+   for (i = 0; i < g->cells; i++) {
+      if (puzzle[i] > g->n) {
+         cdoku_session_destroy(g);
+         return CDOKU_ERR_ARGS;
+      }
+      g->given[i] = puzzle[i] != 0;
+   }
+
+   /* select the givens first, so they sit below every move */
+   for (i = 0; i < g->cells; i++)
+      if (puzzle[i] && !session_select(g, i, puzzle[i])) {
+         cdoku_session_destroy(g);
+         return CDOKU_CONFLICT;
+      }
+
+   *session = g;
+   return CDOKU_SOLVED;
+}
+
+void cdoku_session_destroy(cdoku_session *session) {
+   if (session) {
+      if (session->s)
+         free_solver(session->s);
+      free(session->grid);
+      free(session->given);
+      free(session->moves);
+      free(session->solution);
+      free(session);
+   }
+}
+
+void cdoku_session_set_limits(cdoku_session *session, unsigned long nodes,
+      double seconds) {
+   search_limits limits;
+
+   if (!session)
+      return;
+   limits.nodes = nodes;
+   limits.seconds = seconds > 0 ? seconds : 0;
+   solver_set_limits(session->s, &limits);
+   session->searched = 0;
+}
+
+cdoku_status cdoku_session_place(cdoku_session *session, int x, int y,
+      int value) {
+   if (!session || x < 0 || x >= session->n || y < 0 || y >= session->n
+         || value < 1 || value > session->n || session->grid[y*session->n + x])
+      return CDOKU_ERR_ARGS;
+
+   return session_select(session, y*session->n + x, value)
+        ? CDOKU_SOLVED : CDOKU_CONFLICT;
+}
+
+cdoku_status cdoku_session_remove(cdoku_session *session, int x, int y) {
+   cdoku_session *const g = session;
+   int cell, i, j, count;
+
+   if (!g || x < 0 || x >= g->n || y < 0 || y >= g->n)
+      return CDOKU_ERR_ARGS;
+   cell = y*g->n + x;
+   if (!g->grid[cell] || g->given[cell])
+      return CDOKU_ERR_ARGS;
+
+   /* the matrix undoes selections last in, first out, so take back every
+    * move made since this one, then make them again without it */
+   for (i = g->count - 1; g->moves[i] != cell; i--)
+      ;
+   for (j = g->count; j > i; j--)
+      solver_unselect(g->s);
+   g->grid[cell] = 0;
+   count = g->count;
+   g->count = i;
+   for (j = i + 1; j < count; j++)
+      session_select(g, g->moves[j], g->grid[g->moves[j]]);
+   g->searched = 0;
+   return CDOKU_SOLVED;
+}
+
+cdoku_status cdoku_session_check(cdoku_session *session) {
+   if (!session)
+      return CDOKU_ERR_ARGS;
+   return session_search(session);
+}
+
+cdoku_status cdoku_session_hint(cdoku_session *session, int *x, int *y,
+      int *value) {
+   if (!session || !x || !y || !value)
+      return CDOKU_ERR_ARGS;
+
+   switch (solver_forced(session->s, x, y, value)) {
+   case 1:
+      ++*value;
+      return CDOKU_SOLVED;
+   case -1:
+      return CDOKU_NO_SOLUTION;
+   default:
+      return CDOKU_NO_HINT;
+   }
+}
+
+cdoku_status cdoku_session_solution(cdoku_session *session,
+      uint8_t *solution) {
+   cdoku_status st;
+
+   if (!session || !solution)
+      return CDOKU_ERR_ARGS;
+   if ((st = session_search(session)) == CDOKU_SOLVED)
+      memcpy(solution, session->solution, session->cells);
+   return st;
+}
+
+const char *cdoku_strerror(cdoku_status status) {
+   switch (status) {
+   case CDOKU_SOLVED:
+      return "solved";
+   case CDOKU_NO_SOLUTION:
+      return "no solution";
+   case CDOKU_GAVE_UP:
+      return "gave up";
+   case CDOKU_NO_HINT:
+      return "no forced cell";
+   case CDOKU_CONFLICT:
+      return "conflicting value";
+   case CDOKU_ERR_ARGS:
+      return "invalid argument";
+   case CDOKU_ERR_NOMEM:
+      return "out of memory";
+   }
+   return "unknown status";
+}
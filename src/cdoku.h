@@ -0,0 +1,142 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* libcdoku: the public interface to the solver, for embedding it in other
+ * programs. A grid is n*n bytes in row-major order, where n = k*k, holding
+ * 0 for an empty cell and 1..n for a given value. Contexts are independent
+ * of each other, so any number of threads can solve at once as long as
+ * each uses its own context. No call ever exits the program; failures are
+ * reported through the status codes below. */
+
+#ifndef CDOKU_H_GUARD
+#define CDOKU_H_GUARD
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define CDOKU_API __attribute__((visibility("default")))
+#else
+#define CDOKU_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* a solving context, holding the solver for one grid size */
+typedef struct cdoku cdoku;
+
+/* results of the calls below; errors are negative */
+typedef enum cdoku_status {
+   CDOKU_SOLVED = 0,       /* the solution was written out */
+   CDOKU_NO_SOLUTION = 1,  /* the puzzle can't be solved */
+   CDOKU_GAVE_UP = 2,      /* the search ran past the context's limits */
+   CDOKU_NO_HINT = 3,      /* no empty cell is forced yet */
+   CDOKU_CONFLICT = 4,     /* the value is already in the row, column or box */
+   CDOKU_ERR_ARGS = -1,    /* a bad argument, such as an out of range cell */
+   CDOKU_ERR_NOMEM = -2    /* memory ran out */
+} cdoku_status;
+
+/* creates a context for grids of order k (1 to 8, so 9x9 grids are k = 3),
+ * storing it in *ctx */
+CDOKU_API cdoku_status cdoku_create(cdoku **ctx, int k);
+
+/* frees a context; ctx may be NULL */
+CDOKU_API void cdoku_destroy(cdoku *ctx);
+
+/* limits each search to a number of nodes and a number of seconds, after
+ * which it gives up; 0 means no limit for either */
+CDOKU_API void cdoku_set_limits(cdoku *ctx, unsigned long nodes,
+      double seconds);
+
+/* solves a puzzle, writing the completed grid to solution, which may be the
+ * same buffer as puzzle. solution is left alone unless CDOKU_SOLVED is
+ * returned. */
+CDOKU_API cdoku_status cdoku_solve(cdoku *ctx, const uint8_t *puzzle,
+      uint8_t *solution);
+
+/* solves count puzzles stored back to back, writing each solution to the
+ * matching place in solutions and each outcome to results[i]. Returns the
+ * number of puzzles solved, or a negative status if the arguments are bad;
+ * a puzzle with bad cells only fails its own entry. */
+CDOKU_API int cdoku_solve_batch(cdoku *ctx, const uint8_t *puzzles,
+      uint8_t *solutions, size_t count, cdoku_status *results);
+
+/* a game in progress: the grid as the player has filled it so far, kept in
+ * the solver's matrix so each move and query only searches what's left */
+typedef struct cdoku_session cdoku_session;
+
+/* starts a game on a puzzle of order k, storing it in *session. Returns
+ * CDOKU_CONFLICT without a session if the givens clash with each other. */
+CDOKU_API cdoku_status cdoku_session_create(cdoku_session **session, int k,
+      const uint8_t *puzzle);
+
+/* frees a session; session may be NULL */
+CDOKU_API void cdoku_session_destroy(cdoku_session *session);
+
+/* limits the searches of cdoku_session_check and cdoku_session_solution,
+ * as with cdoku_set_limits */
+CDOKU_API void cdoku_session_set_limits(cdoku_session *session,
+      unsigned long nodes, double seconds);
+
+/* places a value (1 to n) in the empty cell at column x and row y, counting
+ * from 0. Returns CDOKU_CONFLICT and leaves the grid alone if the value is
+ * already in the cell's row, column or box. */
+CDOKU_API cdoku_status cdoku_session_place(cdoku_session *session, int x,
+      int y, int value);
+
+/* empties a cell the player filled; givens can't be removed */
+CDOKU_API cdoku_status cdoku_session_remove(cdoku_session *session, int x,
+      int y);
+
+/* reports whether the grid can still be completed: CDOKU_SOLVED if it can,
+ * CDOKU_NO_SOLUTION if some move so far was wrong */
+CDOKU_API cdoku_status cdoku_session_check(cdoku_session *session);
+
+/* finds an empty cell whose value the grid already forces, because it has
+ * one value left or a value has one place left in a row, column or box, and
+ * stores it in *x, *y and *value. Returns CDOKU_NO_HINT if no cell is
+ * forced or the grid is full, and CDOKU_NO_SOLUTION if some cell or value
+ * has no place left. */
+CDOKU_API cdoku_status cdoku_session_hint(cdoku_session *session, int *x,
+      int *y, int *value);
+
+/* writes a completed grid that agrees with every value placed so far to
+ * solution, which is left alone unless CDOKU_SOLVED is returned */
+CDOKU_API cdoku_status cdoku_session_solution(cdoku_session *session,
+      uint8_t *solution);
+
+/* describes a status code */
+CDOKU_API const char *cdoku_strerror(cdoku_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,239 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "xmalloc.h"
+#include "reader.h"
+#include "solver.h"
+#include "generate.h"
+
+/* number of puzzles handed out at a time, per worker */
+#define GEN_CHUNK_PER_JOB 64
+
+/* state shared between the writing thread and the workers */
+typedef struct gen_pool {
+   pthread_mutex_t lock;
+   pthread_cond_t work; /* signalled when a chunk is ready */
+   pthread_cond_t done; /* signalled when a chunk is finished */
+   char *lines;         /* each puzzle's line, at line_size apart */
+   unsigned line_size;
+   unsigned long first; /* number of the puzzle in the first line */
+   unsigned count;      /* number of lines in the current chunk */
+   unsigned next;       /* next line to hand out */
+   unsigned finished;   /* number of lines finished */
+   int quit;
+   options *opt;
+} gen_pool;
+
+/* the seed for puzzle number i, scrambled so that neighbouring puzzles
+ * don't get related random sequences */
+unsigned long gen_seed(unsigned long seed, unsigned long i) {
+   unsigned long x = seed ^ (i * 0x9E3779B9UL);
+   x ^= x >> 16;
+   x *= 0x85EBCA6BUL;
+   x ^= x >> 13;
+   x *= 0xC2B2AE35UL;
+   x ^= x >> 16;
+   return x;
+}
+
+/* a random number below range, from the same generator the solver uses */
+unsigned gen_random(unsigned long *seed, unsigned range) {
+   *seed = *seed * 1103515245UL + 12345UL;
+   return (*seed >> 16) % range;
+}
+
+/* makes a puzzle with a unique solution: fills a random grid by solving an
+ * empty one with the columns and rows of the search in a random order, then
+ * empties its cells in a random order, keeping each one that can't go
+ * without a second solution appearing, until only clues are left. The
+ * solver is reused throughout, and the same seed gives the same puzzle. */
+void make_puzzle(solver *s, int k, unsigned long seed, int clues,
+      uint8_t *grid) {
+   const int n = k*k;
+   int order[MAX_CELLS];
+   int i, left = n*n;
+
+   /* a random solved grid */
+   memset(grid, 0, n*n);
+   if (!solver_shuffle(s, seed)) {
+      fprintf(stderr, "out of memory, exiting\n");
+      exit(1);
+   }
+   solver_set_strategy(s, PICK_MRV_RANDOM, seed);
+   solver_solve(s, grid, grid);
+   solver_set_strategy(s, PICK_MRV, 0);
+
+   /* the order to empty the cells in */
+   for (i = 0; i < n*n; i++)
+      order[i] = i;
+   for (i = n*n - 1; i > 0; i--) {
+      const int j = gen_random(&seed, i + 1), t = order[i];
+      order[i] = order[j];
+      order[j] = t;
+   }
+
+   /* counting stops at a second solution, which is all it takes to tell
+    * that a cell is needed */
+   for (i = 0; i < n*n && left > clues; i++) {
+      const int cell = order[i], v = grid[cell];
+      grid[cell] = 0;
+      if (solver_enumerate(s, grid, 2, NULL, NULL) == 1)
+         left--;
+      else
+         grid[cell] = v;
+   }
+}
+
+/* worker thread: generates puzzles for the current chunk with its own
+ * solver until told to quit */
+void *gen_worker(void *arg) {
+   gen_pool *p = arg;
+   const int k = p->opt->k;
+   solver *s = xcheck(new_solver(k));
+   uint8_t grid[MAX_CELLS];
+
+   pthread_mutex_lock(&p->lock);
+   for (;;) {
+      while (!p->quit && p->next == p->count)
+         pthread_cond_wait(&p->work, &p->lock);
+      if (p->quit)
+         break;
+
+      /* claim a line and fill it in without holding the lock */
+      const unsigned i = p->next++;
+      const unsigned long num = p->first + i;
+      pthread_mutex_unlock(&p->lock);
+
+      make_puzzle(s, k, gen_seed(p->opt->seed, num), p->opt->clues, grid);
+      format_puzzle(k, grid, p->lines + i*p->line_size);
+
+      pthread_mutex_lock(&p->lock);
+      if (++p->finished == p->count)
+         pthread_cond_signal(&p->done);
+   }
+   pthread_mutex_unlock(&p->lock);
+
+   free_solver(s);
+   return NULL;
+}
+
+/* generates count puzzles with unique solutions on boards of order opt->k
+ * (3 if it's 0) and writes them out one per line, using opt->jobs threads.
+ * Puzzle i comes from opt->seed and i alone, so the output doesn't depend
+ * on the number of threads. Each keeps opt->clues clues if it can, or as
+ * few as it can if that's 0. */
+void generate_puzzles(unsigned long count, const options *given,
+      writer *out) {
+   options local = *given;
+   options *opt = &local;
+   if (!opt->k)
+      opt->k = 3;
+   if (opt->jobs < 1)
+      opt->jobs = 1;
+
+   const unsigned size = opt->flush > 0 &&
+         (unsigned)opt->flush < opt->jobs * GEN_CHUNK_PER_JOB ?
+         (unsigned)opt->flush : opt->jobs * GEN_CHUNK_PER_JOB;
+   const int k = opt->k;
+   pthread_t *threads = xmalloc(opt->jobs * sizeof(pthread_t));
+   solver *s = NULL;
+   gen_pool p;
+   unsigned long n = 0;
+   unsigned i;
+   int j, jobs = 0;
+
+   p.line_size = 2*k*k*k*k + 1;
+   p.lines = xmalloc((size_t)size * p.line_size);
+   p.count = p.next = p.finished = 0;
+   p.quit = 0;
+   p.opt = opt;
+   pthread_mutex_init(&p.lock, NULL);
+   pthread_cond_init(&p.work, NULL);
+   pthread_cond_init(&p.done, NULL);
+
+   /* start the workers; if we can't start any, generate the puzzles here */
+   for (j = 0; j < opt->jobs; j++)
+      if (!pthread_create(&threads[jobs], NULL, gen_worker, &p))
+         jobs++;
+   if (!jobs)
+      s = xcheck(new_solver(k));
+
+   while (n < count) {
+      const unsigned chunk = count - n < size ? count - n : size;
+
+      if (jobs) {
+         pthread_mutex_lock(&p.lock);
+         p.first = n;
+         p.count = chunk;
+         p.next = p.finished = 0;
+         pthread_cond_broadcast(&p.work);
+         while (p.finished < p.count)
+            pthread_cond_wait(&p.done, &p.lock);
+         pthread_mutex_unlock(&p.lock);
+      } else {
+         uint8_t grid[MAX_CELLS];
+         for (i = 0; i < chunk; i++) {
+            make_puzzle(s, k, gen_seed(opt->seed, n + i), opt->clues, grid);
+            format_puzzle(k, grid, p.lines + i*p.line_size);
+         }
+      }
+
+      /* write the lines out in order */
+      for (i = 0; i < chunk; i++) {
+         const char *line = p.lines + i*p.line_size;
+         writer_write(out, line, strchr(line, '\n') - line + 1);
+      }
+      n += chunk;
+
+      /* pass the puzzles on in batches */
+      if (opt->flush > 0 && n / opt->flush != (n - chunk) / opt->flush)
+         writer_flush(out);
+   }
+
+   /* tell the workers to quit and wait for them */
+   pthread_mutex_lock(&p.lock);
+   p.quit = 1;
+   pthread_cond_broadcast(&p.work);
+   pthread_mutex_unlock(&p.lock);
+   for (j = 0; j < jobs; j++)
+      pthread_join(threads[j], NULL);
+
+   if (s)
+      free_solver(s);
+   pthread_mutex_destroy(&p.lock);
+   pthread_cond_destroy(&p.work);
+   pthread_cond_destroy(&p.done);
+   free(p.lines);
+   free(threads);
+}
@@ -0,0 +1,258 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "xmalloc.h"
+#include "gunzip.h"
+
+/* Compressed input is inflated on a thread of its own, so decompression
+ * overlaps with solving. It fills two blocks in turn, each handed over to
+ * the reader once full and refilled once the reader has taken everything
+ * in it, so the memory used is the same however big the archive is. Gzip
+ * files made of several members, as from cat, are read through to the
+ * end. */
+
+/* a decompressing thread and the blocks it hands over */
+struct gunzip {
+   pthread_t thread;
+   pthread_mutex_t lock;
+   pthread_cond_t ready;  /* signalled when a block is filled */
+   pthread_cond_t taken;  /* signalled when a block is emptied */
+   char *block[2];
+   size_t len[2];         /* bytes in each block, 0 while it's filling */
+   size_t pos;            /* bytes the reader has taken from its block */
+   int next;              /* the block the reader takes from next */
+   int last;              /* the last block handed over, or -1 until then */
+   int error;             /* set if the data was corrupt or unreadable */
+   int quit;              /* set to stop the thread early */
+   int started;           /* set if the thread is running */
+   int fd;                /* where the rest of the input comes from, or -1 */
+   const char *data;      /* input to inflate before reading fd */
+   size_t data_len;
+   char *copy;            /* data, if we had to keep a copy of it */
+};
+
+/* whether data starts like a gzip file */
+int is_gzip(const char *data, size_t len) {
+   return len >= 2 && (unsigned char)data[0] == 0x1f &&
+         (unsigned char)data[1] == 0x8b;
+}
+
+/* hands a block over to the reader, then waits for the other one to be
+ * free; returns 0 if we've been told to stop */
+int hand_over(gunzip *g, int b, size_t len, int last) {
+   int quit;
+
+   pthread_mutex_lock(&g->lock);
+   g->len[b] = len;
+   if (last)
+      g->last = b;
+   pthread_cond_signal(&g->ready);
+   while (!g->quit && g->len[!b])
+      pthread_cond_wait(&g->taken, &g->lock);
+   quit = g->quit;
+   pthread_mutex_unlock(&g->lock);
+   return !quit;
+}
+
+/* decompressing thread: inflates the input into the blocks until it ends */
+void *inflate_input(void *arg) {
+   gunzip *g = arg;
+   char *in = g->fd >= 0 ? xmalloc(GUNZIP_INPUT) : NULL;
+   int b = 0, ret = Z_OK, eof = g->fd < 0, error = 0;
+   z_stream z;
+
+   memset(&z, 0, sizeof(z));
+   z.next_in = (Bytef *)g->data;
+   z.avail_in = g->data_len;
+   z.next_out = (Bytef *)g->block[b];
+   z.avail_out = GUNZIP_BLOCK;
+
+   /* 16 more window bits reads a gzip wrapper */
+   if (inflateInit2(&z, 15 + 16) != Z_OK) {
+      free(in);
+      pthread_mutex_lock(&g->lock);
+      g->error = 1;
+      g->last = 0;
+      pthread_cond_signal(&g->ready);
+      pthread_mutex_unlock(&g->lock);
+      return NULL;
+   }
+
+   for (;;) {
+      /* read more input once we run out */
+      if (!z.avail_in && !eof) {
+         ssize_t got;
+         do {
+            got = read(g->fd, in, GUNZIP_INPUT);
+         } while (got < 0 && errno == EINTR);
+         if (got <= 0) {
+            eof = 1;
+            error = got < 0;
+         }
+         z.next_in = (Bytef *)in;
+         z.avail_in = got > 0 ? got : 0;
+      }
+      if (!z.avail_in && eof)
+         break;
+
+      ret = inflate(&z, Z_NO_FLUSH);
+      if (ret == Z_STREAM_END) {
+         /* another member may follow */
+         inflateReset(&z);
+      } else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+         error = 1;
+         break;
+      }
+
+      /* pass the block on once it's full */
+      if (!z.avail_out) {
+         if (!hand_over(g, b, GUNZIP_BLOCK, 0))
+            break;
+         b = !b;
+         z.next_out = (Bytef *)g->block[b];
+         z.avail_out = GUNZIP_BLOCK;
+      }
+   }
+
+   /* a member cut off part way through is an error too */
+   if (ret != Z_STREAM_END && z.total_in)
+      error = 1;
+   inflateEnd(&z);
+   free(in);
+
+   pthread_mutex_lock(&g->lock);
+   g->error = error;
+   pthread_mutex_unlock(&g->lock);
+   hand_over(g, b, GUNZIP_BLOCK - z.avail_out, 1);
+   return NULL;
+}
+
+/* starts decompressing gzip data on another thread: first len bytes from
+ * data, then whatever can be read from fd, if it isn't -1. data is copied
+ * if there's an fd to read, and otherwise must last until the gunzip is
+ * freed, like a mapped file. Returns NULL if the thread can't start. */
+gunzip *new_gunzip(int fd, const char *data, size_t len) {
+   gunzip *g = xmalloc(sizeof(gunzip));
+
+   g->block[0] = xmalloc(GUNZIP_BLOCK);
+   g->block[1] = xmalloc(GUNZIP_BLOCK);
+   g->len[0] = g->len[1] = 0;
+   g->pos = 0;
+   g->next = 0;
+   g->last = -1;
+   g->error = g->quit = g->started = 0;
+   g->fd = fd;
+   g->copy = NULL;
+   if (fd >= 0 && len) {
+      g->copy = xmalloc(len);
+      memcpy(g->copy, data, len);
+      data = g->copy;
+   }
+   g->data = data;
+   g->data_len = len;
+   pthread_mutex_init(&g->lock, NULL);
+   pthread_cond_init(&g->ready, NULL);
+   pthread_cond_init(&g->taken, NULL);
+
+   if (pthread_create(&g->thread, NULL, inflate_input, g)) {
+      free_gunzip(g);
+      return NULL;
+   }
+   g->started = 1;
+   return g;
+}
+
+/* copies up to len bytes of decompressed data into buf, waiting for them
+ * if need be; returns the number copied, which is 0 at the end of the data
+ * and -1 if it was corrupt */
+long gunzip_read(gunzip *g, char *buf, size_t len) {
+   size_t got = 0;
+   int b;
+
+   pthread_mutex_lock(&g->lock);
+   for (;;) {
+      b = g->next;
+      if (g->len[b] || g->last == b)
+         break;
+      pthread_cond_wait(&g->ready, &g->lock);
+   }
+   pthread_mutex_unlock(&g->lock);
+
+   /* the block is ours until we hand it back, so copy without the lock */
+   if (g->len[b] > g->pos) {
+      got = g->len[b] - g->pos < len ? g->len[b] - g->pos : len;
+      memcpy(buf, g->block[b] + g->pos, got);
+      g->pos += got;
+   }
+
+   pthread_mutex_lock(&g->lock);
+   if (g->pos == g->len[b] && g->last != b) {
+      /* hand the empty block back to be filled */
+      g->len[b] = 0;
+      g->pos = 0;
+      g->next = !b;
+      pthread_cond_signal(&g->taken);
+   }
+   if (!got && g->error) {
+      pthread_mutex_unlock(&g->lock);
+      return -1;
+   }
+   pthread_mutex_unlock(&g->lock);
+   return got;
+}
+
+/* stops the decompressing thread and frees everything; returns nonzero if
+ * the data was corrupt or couldn't be read */
+int free_gunzip(gunzip *g) {
+   int error;
+
+   pthread_mutex_lock(&g->lock);
+   g->quit = 1;
+   pthread_cond_signal(&g->taken);
+   pthread_mutex_unlock(&g->lock);
+   if (g->started)
+      pthread_join(g->thread, NULL);
+
+   error = g->error;
+   pthread_mutex_destroy(&g->lock);
+   pthread_cond_destroy(&g->ready);
+   pthread_cond_destroy(&g->taken);
+   free(g->block[0]);
+   free(g->block[1]);
+   free(g->copy);
+   free(g);
+   return error;
+}
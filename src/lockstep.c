@@ -0,0 +1,300 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <string.h>
+#include <pthread.h>
+#include "lockstep.h"
+
+/* Up to LOCKSTEP_LANES 9x9 puzzles are solved at once, each in a 16-bit
+ * lane of every vector: the candidates of a cell across all the puzzles
+ * are one vector, so eliminating candidates and finding naked and hidden
+ * singles is the same few vector operations for every puzzle. There's no
+ * branching, so a puzzle that singles can't finish is left for the
+ * scalar solvers, and the batch only goes on while some puzzle is still
+ * making progress. On x86 the same code is built for AVX-512, AVX2 and
+ * the SSE2 baseline, and the fastest one the CPU supports is used. */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LS_X86
+#endif
+
+/* the lanes are GCC vectors, so other compilers get no lockstep kernel and
+ * every puzzle is left for dlx */
+#ifdef __GNUC__
+
+#define LS_N 9
+#define LS_CELLS 81
+#define LS_ALL 0x1ff
+
+/* a cell's value across all the lanes */
+typedef uint16_t lanes __attribute__((vector_size(2*LOCKSTEP_LANES)));
+
+/* a lanewise condition, all ones where it holds */
+typedef int16_t lane_mask __attribute__((vector_size(2*LOCKSTEP_LANES)));
+
+/* the state of every puzzle in the batch */
+typedef struct batch {
+   lanes cand[LS_CELLS]; /* candidates of each empty cell, 0 once filled */
+   lanes val[LS_CELLS];  /* bit of the value in each filled cell, else 0 */
+   lanes bad;            /* nonzero in lanes that hit a contradiction */
+} batch;
+
+/* runs a kernel over the batch until no lane makes progress */
+typedef void (*ls_kernel)(batch *b);
+
+/* the cells of each unit: the rows, then the columns, then the boxes */
+const unsigned char ls_units[27][LS_N] = {
+   {  0,  1,  2,  3,  4,  5,  6,  7,  8 },
+   {  9, 10, 11, 12, 13, 14, 15, 16, 17 },
+   { 18, 19, 20, 21, 22, 23, 24, 25, 26 },
+   { 27, 28, 29, 30, 31, 32, 33, 34, 35 },
+   { 36, 37, 38, 39, 40, 41, 42, 43, 44 },
+   { 45, 46, 47, 48, 49, 50, 51, 52, 53 },
+   { 54, 55, 56, 57, 58, 59, 60, 61, 62 },
+   { 63, 64, 65, 66, 67, 68, 69, 70, 71 },
+   { 72, 73, 74, 75, 76, 77, 78, 79, 80 },
+   {  0,  9, 18, 27, 36, 45, 54, 63, 72 },
+   {  1, 10, 19, 28, 37, 46, 55, 64, 73 },
+   {  2, 11, 20, 29, 38, 47, 56, 65, 74 },
+   {  3, 12, 21, 30, 39, 48, 57, 66, 75 },
+   {  4, 13, 22, 31, 40, 49, 58, 67, 76 },
+   {  5, 14, 23, 32, 41, 50, 59, 68, 77 },
+   {  6, 15, 24, 33, 42, 51, 60, 69, 78 },
+   {  7, 16, 25, 34, 43, 52, 61, 70, 79 },
+   {  8, 17, 26, 35, 44, 53, 62, 71, 80 },
+   {  0,  1,  2,  9, 10, 11, 18, 19, 20 },
+   {  3,  4,  5, 12, 13, 14, 21, 22, 23 },
+   {  6,  7,  8, 15, 16, 17, 24, 25, 26 },
+   { 27, 28, 29, 36, 37, 38, 45, 46, 47 },
+   { 30, 31, 32, 39, 40, 41, 48, 49, 50 },
+   { 33, 34, 35, 42, 43, 44, 51, 52, 53 },
+   { 54, 55, 56, 63, 64, 65, 72, 73, 74 },
+   { 57, 58, 59, 66, 67, 68, 75, 76, 77 },
+   { 60, 61, 62, 69, 70, 71, 78, 79, 80 }
+};
+
+/* one round of singles in every lane: candidates seen by a filled cell go,
+ * cells left with one candidate are filled, and so is each cell that is
+ * the only place left in some unit for one of its candidates; returns
+ * nonzero if a cell was filled in some lane without a contradiction */
+__inline__ __attribute__((always_inline))
+int ls_round(batch *b) {
+   const lanes none = { 0 }, all = none + LS_ALL;
+   lanes seen[27], moved = none, bad = b->bad;
+   int u, i, c;
+
+   /* the values placed in each unit; a value placed twice is a
+    * contradiction */
+   for (u = 0; u < 27; u++) {
+      lanes acc = none;
+      for (i = 0; i < LS_N; i++) {
+         const lanes v = b->val[ls_units[u][i]];
+         bad |= acc & v;
+         acc |= v;
+      }
+      seen[u] = acc;
+   }
+
+   /* naked singles */
+   for (c = 0; c < LS_CELLS; c++) {
+      const int x = c % LS_N, y = c / LS_N;
+      lanes cand = b->cand[c] &
+            ~(seen[y] | seen[9 + x] | seen[18 + y/3*3 + x/3]);
+      const lanes empty = (lanes)(b->val[c] == 0);
+      const lanes one = (lanes)((cand & (cand - 1)) == 0) & (lanes)(cand != 0);
+
+      /* an empty cell with no candidates is a contradiction */
+      bad |= empty & (lanes)(cand == 0);
+      b->val[c] |= cand & one;
+      moved |= one;
+      b->cand[c] = cand & ~one;
+   }
+
+   /* hidden singles; a cell that is the only place for two values, or a
+    * value with no place left, is a contradiction */
+   for (u = 0; u < 27; u++) {
+      lanes once = none, twice = none, placed = none;
+      for (i = 0; i < LS_N; i++) {
+         const int cell = ls_units[u][i];
+         twice |= once & b->cand[cell];
+         once |= b->cand[cell];
+         placed |= b->val[cell];
+      }
+      bad |= all & ~(once | placed);
+
+      /* values filled this round are still among the candidates of the
+       * cells around them until the next one */
+      once &= ~(twice | placed);
+      for (i = 0; i < LS_N; i++) {
+         const int cell = ls_units[u][i];
+         const lanes h = b->cand[cell] & once;
+         const lanes hit = (lanes)(h != 0);
+         bad |= h & (h - 1);
+         b->val[cell] |= h;
+         b->cand[cell] &= ~hit;
+         moved |= hit;
+      }
+   }
+
+   b->bad = bad;
+   moved &= (lanes)(bad == 0);
+   for (i = 0; i < LOCKSTEP_LANES; i++)
+      if (moved[i])
+         return 1;
+   return 0;
+}
+
+/* runs rounds of singles until no lane makes progress */
+__inline__ __attribute__((always_inline))
+void ls_run(batch *b) {
+   while (ls_round(b));
+}
+
+/* the portable kernel, which is SSE2 on x86-64 */
+void ls_run_base(batch *b) {
+   ls_run(b);
+}
+
+#ifdef LS_X86
+/* the kernel built for AVX2 */
+__attribute__((target("avx2")))
+void ls_run_avx2(batch *b) {
+   ls_run(b);
+}
+
+/* the kernel built for AVX-512 */
+__attribute__((target("avx512f,avx512bw,avx512vl")))
+void ls_run_avx512(batch *b) {
+   ls_run(b);
+}
+#endif
+
+/* the kernel for this CPU and its name, chosen once by choose_kernel */
+ls_kernel ls_chosen;
+const char *ls_chosen_name;
+pthread_once_t ls_once = PTHREAD_ONCE_INIT;
+
+/* chooses the fastest kernel the CPU supports */
+void choose_kernel(void) {
+#ifdef LS_X86
+   __builtin_cpu_init();
+   if (__builtin_cpu_supports("avx512bw") &&
+         __builtin_cpu_supports("avx512vl")) {
+      ls_chosen_name = "avx512";
+      ls_chosen = ls_run_avx512;
+      return;
+   }
+   if (__builtin_cpu_supports("avx2")) {
+      ls_chosen_name = "avx2";
+      ls_chosen = ls_run_avx2;
+      return;
+   }
+#endif
+
+   ls_chosen_name = "base";
+   ls_chosen = ls_run_base;
+}
+
+/* returns the kernel for this CPU, storing its name unless name is NULL;
+ * the CPU is only looked at the first time */
+ls_kernel get_kernel(const char **name) {
+   pthread_once(&ls_once, choose_kernel);
+   if (name)
+      *name = ls_chosen_name;
+   return ls_chosen;
+}
+
+/* names the kernel lockstep_solve uses on this CPU */
+const char *lockstep_kernel(void) {
+   const char *name;
+   get_kernel(&name);
+   return name;
+}
+
+/* solves up to LOCKSTEP_LANES 9x9 puzzles together using singles alone.
+ * Each puzzle holds its cells in row-major order with 0 for empty cells; a
+ * NULL puzzle is left alone. A solved puzzle's solution is written into
+ * the matching out grid, and results says what became of each. */
+void lockstep_solve(int count, const uint8_t *const *puzzles, uint8_t **out,
+      lockstep_result *results) {
+   batch b;
+   int i, c;
+
+   /* load the puzzles into lanes; empty lanes are already solved */
+   memset(&b, 0, sizeof(b));
+   for (i = 0; i < LOCKSTEP_LANES; i++) {
+      const uint8_t *p = i < count ? puzzles[i] : NULL;
+      for (c = 0; c < LS_CELLS; c++) {
+         if (!p)
+            b.val[c][i] = 1;
+         else if (p[c])
+            b.val[c][i] = 1u << (p[c] - 1);
+         else
+            b.cand[c][i] = LS_ALL;
+      }
+   }
+
+   get_kernel(NULL)(&b);
+
+   /* read each puzzle back out of its lane */
+   for (i = 0; i < count; i++) {
+      int full = 1;
+
+      if (!puzzles[i] || b.bad[i]) {
+         results[i] = puzzles[i] ? LOCKSTEP_NONE : LOCKSTEP_STUCK;
+         continue;
+      }
+      for (c = 0; c < LS_CELLS && full; c++) {
+         const unsigned v = b.val[c][i];
+         full = v != 0;
+         if (full)
+            out[i][c] = __builtin_ctz(v) + 1;
+      }
+      results[i] = full ? LOCKSTEP_SOLVED : LOCKSTEP_STUCK;
+   }
+}
+
+#else
+
+/* leaves every puzzle for a search */
+void lockstep_solve(int count, const uint8_t *const *puzzles, uint8_t **out,
+      lockstep_result *results) {
+   int i;
+
+   for (i = 0; i < count; i++)
+      results[i] = LOCKSTEP_STUCK;
+}
+
+/* names the kernel lockstep_solve uses, which is none at all */
+const char *lockstep_kernel(void) {
+   return "none";
+}
+
+#endif
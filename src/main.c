@@ -28,84 +28,479 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "xmalloc.h"
 #include "reader.h"
 #include "solver.h"
+#include "options.h"
+#include "report.h"
+#include "batch.h"
+#include "generate.h"
+#include "serve.h"
+#include "bitboard.h"
+#include "lockstep.h"
+#include "output.h"
+#include "cache.h"
+#include "packed.h"
 
 #define CONST_K 3
-#define CONST_N 9
 
-/* solves all the Sudoku puzzles in the given file */
-void solve_file(char *name) {
-   FILE *file;
-   int x, y;
+/* size of the solution cache in megabytes, unless --cache says otherwise */
+#define CACHE_MB 64
+
+/* returns the solver for order k, building it the first time it's needed
+ * so each board size's matrix is only built once */
+solver *get_solver(solver **solvers, int k) {
+   if (!solvers[k])
+      solvers[k] = xcheck(new_solver(k));
+   return solvers[k];
+}
+
+/* starts a packed output of order k, with a count of records that's filled
+ * in by end_packed; returns where the header is, to hand to end_packed */
+size_t begin_packed(writer *out, int k, packed_kind kind) {
+   const size_t at = writer_tell(out);
+   char header[PACKED_HEADER];
+
+   packed_header(header, k, kind, PACKED_UNKNOWN);
+   writer_write(out, header, PACKED_HEADER);
+   return at;
+}
+
+/* fills in the count of a packed output started by begin_packed, from the
+ * size of what came after its header; if the output can't be seeked the
+ * count is left unknown, so its records run to the end of the output */
+void end_packed(writer *out, size_t at, int k, packed_kind kind) {
+   char header[PACKED_HEADER];
+
+   packed_header(header, k, kind, (writer_tell(out) - at - PACKED_HEADER)
+         / packed_record_size(k, kind));
+   writer_patch(out, at, header, PACKED_HEADER);
+}
+
+/* copies the puzzles in a file to the output without solving them: packed
+ * with -o binary, and otherwise one per line. A packed results file is
+ * copied as it is with -o binary, and otherwise written out in the line
+ * format. */
+void convert_file(reader *file, int kind, options *opt, writer *out) {
+   const int k = opt->k, n = k*k;
+   const size_t cells = packed_cells_size(k);
+   const int binary = opt->style == FORMAT_BINARY;
+   uint8_t grid[MAX_CELLS];
+   const char *record;
+   unsigned long i = 0;
+   int valid;
+
+   if (kind == PACKED_RESULTS) {
+      while ((record = reader_record(file))) {
+         if (binary) {
+            writer_write(out, record, cells + 1);
+         } else if (record[0] == PACKED_SOLVED &&
+               unpack_cells(k, record + 1, grid)) {
+            writer_commit(out, format_puzzle(k, grid,
+                  writer_reserve(out, 2*n*n + 1)));
+         } else {
+            writer_puts(out, record[0] == PACKED_NO_SOLUTION
+                  ? "No solution.\n" : record[0] == PACKED_GAVE_UP
+                  ? "Gave up.\n" : "Invalid length.\n");
+         }
+         if (opt->flush && ++i % opt->flush == 0)
+            writer_flush(out);
+      }
+      return;
+   }
+
+   while ((valid = reader_puzzle(file, k, grid)) >= 0) {
+      if (!valid) {
+         /* a puzzle that couldn't be read stays unreadable, so the rest
+          * keep their numbers */
+         memset(grid, 0xff, n*n);
+      }
+      if (binary) {
+         pack_cells(k, grid, writer_reserve(out, cells));
+         writer_commit(out, cells);
+      } else if (valid) {
+         writer_commit(out, format_puzzle(k, grid,
+               writer_reserve(out, 2*n*n + 1)));
+      } else {
+         writer_puts(out, "\n");
+      }
+      if (opt->flush && ++i % opt->flush == 0)
+         writer_flush(out);
+   }
+}
+
+/* solves all the puzzles in a file with the lockstep solver, which takes
+ * them LOCKSTEP_LANES at a time; the ones it can't finish are solved by s,
+ * and the output is the same as going one puzzle at a time */
+void solve_lockstep(reader *file, solver *s, options *opt, writer *out,
+      search_stats *total) {
+   const unsigned size = report_size(opt->k);
+   uint8_t cells[LOCKSTEP_LANES][MAX_CELLS], soln[LOCKSTEP_LANES][MAX_CELLS];
+   const uint8_t *puzzles[LOCKSTEP_LANES];
+   uint8_t *solns[LOCKSTEP_LANES];
+   lockstep_result results[LOCKSTEP_LANES];
+   search_stats stats;
+   unsigned i = 0;
+   int j, count, got = 0;
+
+   /* batches are no bigger than opt->flush, so a stream isn't kept
+    * waiting for puzzles that haven't arrived */
+   const int lanes = opt->flush > 0 && opt->flush < LOCKSTEP_LANES
+         ? opt->flush : LOCKSTEP_LANES;
+
+   for (j = 0; j < LOCKSTEP_LANES; j++)
+      solns[j] = soln[j];
+
+   while (got >= 0) {
+      /* gather a batch of puzzles until the file ends */
+      for (count = 0; count < lanes &&
+            (got = reader_puzzle(file, opt->k, cells[count])) >= 0; count++)
+         puzzles[count] = got ? cells[count] : NULL;
+      if (!count)
+         break;
+
+      lockstep_solve(count, puzzles, solns, results);
+
+      for (j = 0; j < count; j++) {
+         writer_commit(out, report_lockstep(writer_reserve(out, size), ++i,
+               puzzles[j], results[j], soln[j], s, opt,
+               opt->stats ? &stats : NULL));
+         if (opt->stats)
+            report_tally(total, &stats, i, opt);
+
+         /* pass the results on in batches */
+         if (opt->flush && i % opt->flush == 0)
+            writer_flush(out);
+      }
+   }
+}
+
+/* solves all the Sudoku puzzles in the given file, or in stdin if it's
+ * named "-"; an order of 0 means the order is worked out from the length of
+ * the first line */
+void solve_file(char *name, solver **solvers, options *given, writer *out) {
+   options local = *given;
+   options *opt = &local;
+   search_stats total, stats;
+   cache_stats before, after;
+   unsigned size;
+   size_t header;
+   reader *file;
+   solver *s;
+   int kind;
+
+   /* stdin is read as a stream, as puzzles arrive */
+   const int stream = !strcmp(name, "-");
+
+   /* only the full report has headers, and streams and conversions don't
+    * get them either */
+   const int full = opt->style == FORMAT_FULL && !opt->convert;
+
+   if (opt->flush < 0)
+      opt->flush = stream;
 
    /* try to open the file */
-   if (file = fopen(name, "r")) {
-      printf("Reading from file: %s\n", name);
-      unsigned i = 0;
+   if (file = stream ? fd_reader(0) : open_reader(name)) {
+      /* packed files say what order they are */
+      const int found = detect_input(file, &kind);
+      if (kind || !opt->k)
+         opt->k = found ? found : CONST_K;
 
-      /* keep going until the file ends */
-      for (;;) {
-         /* try to get the next puzzle */
-         int **puzzle = next_puzzle(CONST_K, file);
+      /* results can only be converted, and counts have no packed form */
+      if (kind == PACKED_RESULTS && !opt->convert) {
+         fprintf(stderr, "Can't solve a results file: %s\n", name);
+         close_reader(file);
+         return;
+      }
+      if (opt->style == FORMAT_BINARY && opt->count && !opt->convert) {
+         fprintf(stderr, "Counts can't be written in binary: %s\n", name);
+         close_reader(file);
+         return;
+      }
+      size = report_size(opt->k);
+      memset(&total, 0, sizeof(search_stats));
+      if (opt->cache)
+         cache_get_stats(opt->cache, &before);
 
-         /* if we hit an EOF, call it quits */
-         if (feof(file))
-            break;
+      if (full && !stream) {
+         writer_puts(out, "Reading from file: ");
+         writer_puts(out, name);
+         writer_puts(out, "\n");
+      }
 
-         /* make sure the puzzle was valid */
-         printf("   Solving puzzle #%u: ", ++i);
-         if (puzzle) {
-            int **soln;
-
-            /* valid puzzle, try to solve it */
-            if (soln = solve(CONST_K, puzzle)) {
-               /* found a solution, print it out and clean up */
-               printf("Solved.\n");
-
-               for (y = 0; y < CONST_N; y++) {
-                  printf("      ");
-                  for (x = 0; x < CONST_N; x++)
-                     printf("%x", soln[x][y]);
-                  printf("\n");
-               }
-
-               free_puzzle(CONST_K, soln);
-            } else {
-               /* puzzle couldn't be solved */
-               printf("No solution.\n");
-            }
+      /* a packed output gets a header, whose count is filled in at the
+       * end if the output can be seeked */
+      const packed_kind packed = opt->convert && kind != PACKED_RESULTS
+            ? PACKED_PUZZLES : PACKED_RESULTS;
+      const int binary = opt->style == FORMAT_BINARY;
+      if (binary)
+         header = begin_packed(out, opt->k, packed);
+
+      if (opt->convert) {
+         /* copy the puzzles across without solving them */
+         convert_file(file, kind, opt, out);
+      } else if (opt->jobs > 1 && !opt->split) {
+         /* hand the puzzles out to worker threads */
+         solve_parallel(file, opt, out, &total);
+      } else if (lockstep_usable(opt)) {
+         /* solve the puzzles a batch at a time */
+         solve_lockstep(file, get_solver(solvers, opt->k), opt, out, &total);
+      } else {
+         s = get_solver(solvers, opt->k);
+         uint8_t puzzle[MAX_CELLS];
+         unsigned i = 0;
+         int valid;
+
+         /* keep going until the file ends */
+         while ((valid = reader_puzzle(file, opt->k, puzzle)) >= 0) {
+            /* solve it and report the result straight into the output */
+            writer_commit(out, report_puzzle(writer_reserve(out, size), ++i,
+                  valid ? puzzle : NULL, s, opt,
+                  opt->stats ? &stats : NULL));
+            if (opt->stats)
+               report_tally(&total, &stats, i, opt);
+
+            /* pass the results on in batches */
+            if (opt->flush && i % opt->flush == 0)
+               writer_flush(out);
+         }
+      }
+
+      if (binary)
+         end_packed(out, header, opt->k, packed);
+
+      if (opt->stats)
+         report_total(out, &total, opt);
+      if (opt->cache) {
+         cache_get_stats(opt->cache, &after);
+         report_cache(out, &before, &after, opt);
+      }
 
-            /* clean up our mess */
-            free_puzzle(CONST_K, puzzle);
+      /* closing fails if a compressed file turned out to be corrupt, so
+       * the compact formats report it too */
+      if (close_reader(file)) {
+         if (full) {
+            writer_puts(out, "Failed to close file: ");
+            writer_puts(out, name);
+            writer_puts(out, "\n");
          } else {
-            /* puzzle wasn't valid... the only way this can happen is if the
-             * puzzle was the wrong length */
-            printf("Invalid length.\n");
+            fprintf(stderr, "Failed to close file: %s\n", name);
          }
       }
-      /* check fclose return value, just for good practice */
-      if (fclose(file))
-         printf("Failed to close file: %s\n", name);
+   } else if (full) {
+      writer_puts(out, "Couldn't open file: ");
+      writer_puts(out, name);
+      writer_puts(out, "\n");
    } else {
-      printf("Couldn't open file: %s\n", name);
+      /* keep the compact formats clean, but don't fail silently */
+      fprintf(stderr, "Couldn't open file: %s\n", name);
    }
 }
 
+/* prints usage information */
+void usage(char *prog) {
+   printf("cdoku - DLX Sudoku Solver in C\n");
+   printf("usage: %s [options] [file|-]...\n", prog);
+   printf("options:\n");
+   printf("   -k N|auto            board order, N*N by N*N (default auto)\n");
+   printf("   -b dlx|bitboard|lockstep\n");
+   printf("                        solving backend (default dlx)\n");
+   printf("   -s mrv|type|random   column selection strategy (default mrv)\n");
+   printf("   --seed N             seed for the random strategy\n");
+   printf("   --count[=limit]      count solutions, stopping at limit\n");
+   printf("   -j N                 solve on N threads\n");
+   printf("   --split              split each puzzle between the threads\n");
+   printf("   --stats              report the effort of each search\n");
+   printf("   --serve PATH         answer puzzles on a Unix socket\n");
+   printf("   --generate N         write out N new puzzles with unique\n");
+   printf("                        solutions, seeded by --seed\n");
+   printf("   --clues N            leave N clues in generated puzzles\n");
+   printf("                        (default as few as possible)\n");
+   printf("   --nodes N            give up on a puzzle after N search nodes\n");
+   printf("   --timeout S          give up on a puzzle after S seconds\n");
+   printf("   --cache MB           cache solutions, up to MB megabytes\n");
+   printf("   --cache-file PATH    keep the cache in PATH between runs\n");
+   printf("   --flush N            flush the output every N puzzles\n");
+   printf("                        (default 1 for stdin, 0 for files)\n");
+   printf("   --convert            copy puzzles to the output, unsolved\n");
+   printf("   -o full|line|solution|failures|binary\n");
+   printf("                        output format (default full)\n");
+   printf("bitboard kernel: %s\n", bitboard_kernel());
+   printf("lockstep kernel: %s\n", lockstep_kernel());
+}
+
+/* builds the solution cache the first time it's needed, filling it from its
+ * file if there is one; a file that can't be read is left alone, rather
+ * than being written over on the way out. Returns 0 if the file couldn't
+ * be read; the run carries on with an empty cache, but fails at the end. */
+int open_cache(options *opt, size_t mb, char **file) {
+   if (opt->cache || (!mb && !*file))
+      return 1;
+   opt->cache = new_cache((mb ? mb : CACHE_MB) << 20);
+   if (*file && !cache_load(opt->cache, *file)) {
+      fprintf(stderr, "Couldn't read cache file: %s\n", *file);
+      *file = NULL;
+      return 0;
+   }
+   return 1;
+}
+
 /* main program */
 int main(int argc, char **argv) {
-   int i;
+   options opt;
+   int i, files = 0, status = 0, bad = 0;
+   size_t cache_mb = 0;
+   char *cache_file = NULL;
 
-   /* check number of arguments */
-   if (argc > 1) {
-      /* solve the puzzles provided */
-      for (i = 1; i < argc; i++)
-         solve_file(argv[i]);
-   } else {
-      /* no arguments, print usage */
-      printf("cdoku - DLX Sudoku Solver in C\n");
-      printf("usage: %s [file]...\n", argv[0]);
+   opt.k = 0;
+   opt.engine = BACKEND_DLX;
+   opt.strategy = PICK_MRV;
+   opt.seed = 1;
+   opt.count = 0;
+   opt.limit = 0;
+   opt.jobs = 1;
+   opt.split = 0;
+   opt.style = FORMAT_FULL;
+   opt.flush = -1;
+   opt.stats = 0;
+   opt.limits.nodes = 0;
+   opt.limits.seconds = 0;
+   opt.cache = NULL;
+   opt.clues = 0;
+   opt.convert = 0;
+
+   /* a solver is built once per board size and reused for every puzzle,
+    * and all the results go through one output buffer */
+   solver *solvers[MAX_K+1] = { NULL };
+   writer *out = new_writer(1);
+
+   /* options apply to every file named after them; a bad one stops the run,
+    * but the results of the files before it are still written out */
+   for (i = 1; i < argc; i++) {
+      if (!strcmp(argv[i], "-k") && i+1 < argc) {
+         char *k = argv[++i];
+         if (!strcmp(k, "auto")) {
+            opt.k = 0;
+         } else {
+            opt.k = atoi(k);
+            if (opt.k < 1 || opt.k > MAX_K) {
+               bad = 1;
+               break;
+            }
+         }
+      } else if (!strcmp(argv[i], "-b") && i+1 < argc) {
+         char *b = argv[++i];
+         if (!strcmp(b, "dlx")) {
+            opt.engine = BACKEND_DLX;
+         } else if (!strcmp(b, "bitboard")) {
+            opt.engine = BACKEND_BITBOARD;
+         } else if (!strcmp(b, "lockstep")) {
+            opt.engine = BACKEND_LOCKSTEP;
+         } else {
+            bad = 1;
+            break;
+         }
+      } else if (!strcmp(argv[i], "-s") && i+1 < argc) {
+         char *s = argv[++i];
+         if (!strcmp(s, "mrv")) {
+            opt.strategy = PICK_MRV;
+         } else if (!strcmp(s, "type")) {
+            opt.strategy = PICK_MRV_TYPE;
+         } else if (!strcmp(s, "random")) {
+            opt.strategy = PICK_MRV_RANDOM;
+         } else {
+            bad = 1;
+            break;
+         }
+      } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+         opt.seed = strtoul(argv[++i], NULL, 10);
+      } else if (!strcmp(argv[i], "--count")) {
+         opt.count = 1;
+         opt.limit = 0;
+      } else if (!strncmp(argv[i], "--count=", 8)) {
+         opt.count = 1;
+         opt.limit = strtoul(argv[i]+8, NULL, 10);
+      } else if (!strcmp(argv[i], "-j") && i+1 < argc) {
+         opt.jobs = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--flush") && i+1 < argc) {
+         opt.flush = atoi(argv[++i]);
+         if (opt.flush < 0)
+            opt.flush = 0;
+      } else if (!strcmp(argv[i], "--cache") && i+1 < argc) {
+         cache_mb = strtoul(argv[++i], NULL, 10);
+      } else if (!strcmp(argv[i], "--cache-file") && i+1 < argc) {
+         cache_file = argv[++i];
+      } else if (!strcmp(argv[i], "--serve") && i+1 < argc) {
+         /* serve puzzles with the options so far until we're stopped */
+         const int cached = open_cache(&opt, cache_mb, &cache_file);
+         status = serve(argv[++i], &opt) || !cached;
+         files++;
+         break;
+      } else if (!strcmp(argv[i], "--generate") && i+1 < argc) {
+         generate_puzzles(strtoul(argv[++i], NULL, 10), &opt, out);
+         files++;
+      } else if (!strcmp(argv[i], "--clues") && i+1 < argc) {
+         opt.clues = atoi(argv[++i]);
+      } else if (!strcmp(argv[i], "--nodes") && i+1 < argc) {
+         opt.limits.nodes = strtoul(argv[++i], NULL, 10);
+      } else if (!strcmp(argv[i], "--timeout") && i+1 < argc) {
+         opt.limits.seconds = strtod(argv[++i], NULL);
+      } else if (!strcmp(argv[i], "--stats")) {
+#ifdef DLX_STATS
+         opt.stats = 1;
+#else
+         fprintf(stderr, "--stats needs a build with -DDLX_STATS "
+               "(make FLAGS=-DDLX_STATS)\n");
+         status = 1;
+         break;
+#endif
+      } else if (!strcmp(argv[i], "--split")) {
+         opt.split = 1;
+      } else if (!strcmp(argv[i], "--convert")) {
+         opt.convert = 1;
+      } else if (!strcmp(argv[i], "-o") && i+1 < argc) {
+         char *o = argv[++i];
+         if (!strcmp(o, "full")) {
+            opt.style = FORMAT_FULL;
+         } else if (!strcmp(o, "line")) {
+            opt.style = FORMAT_LINE;
+         } else if (!strcmp(o, "solution")) {
+            opt.style = FORMAT_SOLUTION;
+         } else if (!strcmp(o, "failures")) {
+            opt.style = FORMAT_FAILURES;
+         } else if (!strcmp(o, "binary")) {
+            opt.style = FORMAT_BINARY;
+         } else {
+            bad = 1;
+            break;
+         }
+      } else {
+         /* solve the puzzles provided */
+         if (!open_cache(&opt, cache_mb, &cache_file))
+            status = 1;
+         solve_file(argv[i], solvers, &opt, out);
+         files++;
+      }
+   }
+
+   free_writer(out);
+
+   /* a bad option or no files, print usage after any results */
+   if (bad || (!files && !status))
+      usage(argv[0]);
+   if (bad)
+      status = 1;
+   if (opt.cache) {
+      if (cache_file && !cache_save(opt.cache, cache_file)) {
+         fprintf(stderr, "Couldn't write cache file: %s\n", cache_file);
+         status = 1;
+      }
+      free_cache(opt.cache);
    }
+   for (i = 0; i <= MAX_K; i++)
+      if (solvers[i])
+         free_solver(solvers[i]);
 
-   return 0;
+   return status;
 }
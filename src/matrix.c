@@ -26,256 +26,772 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 #include "xmalloc.h"
-#include "stack.h"
 #include "matrix.h"
 
-/* represents a node in the DLX matrix */
-struct node {
-   void *r;
-   struct node *prev, *next, *up, *down, *head;
-};
+/* how many levels a search with limits enters between looking at the
+ * clock */
+#define LIMIT_SLICE 1024
+
+/* The matrix is stored Knuth-style as a handful of parallel arrays indexed by
+ * node number, rather than as individually allocated nodes. Node 0 is the
+ * root, nodes 1 to w are the column headers, and the rows follow, stored
+ * consecutively and separated by spacer nodes. A spacer's top is -r, where r
+ * is the number of the row that follows it; its up link points at the first
+ * node of the row before it and its down link at the last node of the row
+ * after it, which lets us walk a row cyclically without left/right links. */
 
 /* represents the DLX matrix itself */
 struct matrix {
-   node **row; /* nodes at the bottom of each column */
-   node *root; /* DLX root note */
+   unsigned w;         /* number of columns */
+   unsigned nodes;     /* number of nodes in use, including the last spacer */
+   unsigned node_cap;  /* number of nodes allocated */
+   unsigned rows;      /* number of rows */
+   unsigned row_cap;   /* number of rows allocated */
+   unsigned base;      /* number of rows selected ahead of the search */
+   unsigned depth;     /* current level of the search */
+   int phase;          /* what the search does next at that level */
+
+   /* column header list, indexed by column number */
+   dlx_index *prev, *next; /* neighboring live columns */
+   dlx_index *size;        /* number of live nodes in each column */
+   int *type;              /* constraint type of each column */
+
+   /* node arrays */
+   dlx_top *top;           /* column of each node, or -row for spacers */
+   dlx_index *up, *down;   /* vertical links */
+
+   dlx_index *start;       /* first node of each row */
+   dlx_index *sol;         /* selected rows, followed by the node being
+                            * tried at each level of the search */
+   unsigned *out;          /* scratch list of solution rows */
+
+   dlx_index (*pick)(matrix *m); /* column selection strategy */
+   unsigned long seed;     /* state for randomized tie-breaking */
+
+   search_stats stats;     /* effort counters, with -DDLX_STATS */
+   unsigned long visits;   /* levels the last matrix_search entered */
 };
 
-/* picks the column with the minimum number of nodes */
-node *get_col(matrix *m) {
-   node *result = NULL;
-   int count = -1, c;
+/* counts something in the matrix's stats, or nothing at all unless the
+ * counters are built in */
+#ifdef DLX_STATS
+#define STAT(x) (x)
+#else
+#define STAT(x) ((void)0)
+#endif
+
+/* phases of the search; the phase and depth are kept in the matrix along
+ * with the nodes being tried, so a paused search can carry on exactly where
+ * it stopped */
+enum {
+   PHASE_ENTER, /* pick and cover a column at the current level */
+   PHASE_TRY,   /* try the current level's node, or give up on the column */
+   PHASE_LEAVE, /* back out of the current level into the one above */
+   PHASE_DONE   /* every possibility has been tried */
+};
+
+/* the node after p in p's row, wrapping around at the spacer */
+#define ROW_NEXT(m, p) ((m)->top[(p)+1] <= 0 ? (m)->up[(p)+1] : (p)+1)
+
+/* the node before p in p's row, wrapping around at the spacer */
+#define ROW_PREV(m, p) ((m)->top[(p)-1] <= 0 ? (m)->down[(p)-1] : (p)-1)
 
-   node *head, *n;
-   for (head = m->root->next; head != m->root; head = head->next) {
-      /* count the nodes in the column */
-      c = 0;
-      for (n = head->down; n != head; n = n->down, c++);
+/* picks the first column with the minimum number of nodes */
+dlx_index pick_mrv(matrix *m) {
+   dlx_index result = 0, c;
 
+   for (c = m->next[0]; c; c = m->next[c]) {
       /* if there are no nodes, pick the column */
-      if (!c)
-         return head;
+      if (!m->size[c])
+         return c;
 
       /* otherwise, test it against the current minimum */
-      if (count == -1 || c < count) {
-         count = c;
-         result = head;
-      }
+      if (!result || m->size[c] < m->size[result])
+         result = c;
    }
 
    /* return what we found */
    return result;
 }
 
+/* picks a column with the minimum number of nodes, preferring the lowest
+ * constraint type among columns of equal size */
+dlx_index pick_mrv_type(matrix *m) {
+   dlx_index result = 0, c;
+
+   for (c = m->next[0]; c; c = m->next[c]) {
+      if (!m->size[c])
+         return c;
+
+      if (!result || m->size[c] < m->size[result] ||
+            (m->size[c] == m->size[result] && m->type[c] < m->type[result]))
+         result = c;
+   }
+
+   return result;
+}
+
+/* picks a column with the minimum number of nodes, breaking ties uniformly
+ * at random */
+dlx_index pick_mrv_random(matrix *m) {
+   dlx_index result = 0, c;
+   unsigned ties = 0;
+
+   for (c = m->next[0]; c; c = m->next[c]) {
+      if (!m->size[c])
+         return c;
+
+      if (!result || m->size[c] < m->size[result]) {
+         result = c;
+         ties = 1;
+      } else if (m->size[c] == m->size[result]) {
+         /* reservoir sampling: replace the pick with probability 1/ties */
+         m->seed = m->seed * 1103515245UL + 12345UL;
+         if ((m->seed >> 16) % ++ties == 0)
+            result = c;
+      }
+   }
+
+   return result;
+}
+
+/* picks the next column to cover using the matrix's strategy */
+dlx_index get_col(matrix *m) {
+   return m->pick(m);
+}
+
 /* eliminates a column from the matrix in such a way that it can be easily
  * re-inserted later */
-void cover_col(node *head) {
+void cover_col(matrix *m, dlx_index c) {
+   dlx_index *const up = m->up, *const down = m->down;
+   dlx_index p, q;
+
+   STAT(m->stats.covers++);
+
    /* eliminate the column from the header row */
-   head->prev->next = head->next;
-   head->next->prev = head->prev;
+   m->next[m->prev[c]] = m->next[c];
+   m->prev[m->next[c]] = m->prev[c];
 
    /* eliminate all rows that the column contains an element in */
-   node *x, *y;
-   for (y = head->down; y != head; y = y->down) {
-      for (x = y->next; x != y; x = x->next) {
-         x->up->down = x->down;
-         x->down->up = x->up;
+   for (p = down[c]; p != c; p = down[p]) {
+      for (q = ROW_NEXT(m, p); q != p; q = ROW_NEXT(m, q)) {
+         down[up[q]] = down[q];
+         up[down[q]] = up[q];
+         m->size[m->top[q]]--;
       }
    }
 }
 
-void uncover_col(node *head) {
+/* re-inserts a column eliminated by cover_col; everything is restored in the
+ * reverse of the order it was removed in, otherwise the live column sizes
+ * drift when overlapping rows are re-linked twice */
+void uncover_col(matrix *m, dlx_index c) {
+   dlx_index *const up = m->up, *const down = m->down;
+   dlx_index p, q;
+
    /* re-insert the column's header node */
-   head->prev->next = head;
-   head->next->prev = head;
+   m->next[m->prev[c]] = c;
+   m->prev[m->next[c]] = c;
 
    /* re-insert all rows that the column contains an element in */
-   node *x, *y;
-   for (y = head->down; y != head; y = y->down) {
-      for (x = y->next; x != y; x = x->next) {
-         x->up->down = x;
-         x->down->up = x;
+   for (p = up[c]; p != c; p = up[p]) {
+      for (q = ROW_PREV(m, p); q != p; q = ROW_PREV(m, q)) {
+         down[up[q]] = q;
+         up[down[q]] = q;
+         m->size[m->top[q]]++;
       }
    }
 }
 
-/* converts the solution stack into a list of objects */
-void **get_solution(stack *s, int *len) {
-   /* get the stack size and allocate our list */
-   const unsigned sz = stack_size(s);
-   void **list = xmalloc(sz*sizeof(void*));
-   *len = sz;
+/* covers every column in r's row other than r's own */
+void cover_row(matrix *m, dlx_index r) {
+   dlx_index q;
+   for (q = ROW_NEXT(m, r); q != r; q = ROW_NEXT(m, q))
+      cover_col(m, m->top[q]);
+}
+
+/* undoes cover_row, in reverse order */
+void uncover_row(matrix *m, dlx_index r) {
+   dlx_index q;
+   for (q = ROW_PREV(m, r); q != r; q = ROW_PREV(m, q))
+      uncover_col(m, m->top[q]);
+}
 
-   /* pop items from the stack into the list until the stack is empty */
-   int i = 0;
-   while (stack_size(s)) {
-      node *n = stack_pop(s);
-      node *x;
+/* finds the number of the row a node belongs to */
+unsigned row_of(matrix *m, dlx_index p) {
+   while (m->top[p] > 0)
+      p--;
+   return -m->top[p];
+}
 
-      /* while we're at it, transform the matrix back to it's original state
-       * so we can easily free it later */
-      uncover_col(n->head);
-      for (x = n->next; x != n; x = x->next)
-         uncover_col(x->head);
+/* grows the node and row arrays to at least the given capacities; returns
+ * 0 if there isn't enough memory, in which case the matrix still works at
+ * the capacities it had */
+int matrix_grow(matrix *m, unsigned row_cap, unsigned node_cap) {
+   if (node_cap > m->node_cap) {
+      void *p;
+
+      if (!(p = realloc(m->top, node_cap*sizeof(dlx_top))))
+         return 0;
+      m->top = p;
+      if (!(p = realloc(m->up, node_cap*sizeof(dlx_index))))
+         return 0;
+      m->up = p;
+      if (!(p = realloc(m->down, node_cap*sizeof(dlx_index))))
+         return 0;
+      m->down = p;
+      m->node_cap = node_cap;
+   }
 
-      /* insert the item into the list */
-      list[i++] = n->r;
+   if (row_cap > m->row_cap) {
+      void *p = realloc(m->start, row_cap*sizeof(dlx_index));
+      if (!p)
+         return 0;
+      m->start = p;
+      m->row_cap = row_cap;
    }
 
-   return list;
+   return 1;
 }
 
-/* the actual solver function, which is wrapped by matrix_solve */
-void **matrix_solve_helper(matrix *m, stack *solution, int *len) {
-   /* if the root node is the only node left, we're done */
-   if (m->root == m->root->next)
-      return get_solution(solution, len);
+/* checks that a matrix with the given numbers of rows and nodes can be
+ * indexed with dlx_index and dlx_top */
+int matrix_fits(unsigned long rows, unsigned long nodes) {
+   return rows <= DLX_MAX_ROWS && nodes <= DLX_MAX_NODES;
+}
 
-   /* pick a column and eliminate it */
-   node *head = get_col(m);
-   cover_col(head);
+/* makes room for the given number of additional rows, holding the given
+ * number of nodes between them, so they can be added without reallocating;
+ * returns 0 if there isn't enough memory, or the rows would need more
+ * nodes than dlx_index can number */
+int matrix_reserve(matrix *m, unsigned rows, unsigned nodes) {
+   const unsigned long total = (unsigned long)m->nodes + nodes + rows;
 
-   /* try each row covered by the column picked */
-   node *n, *x;
-   for (n = head->down; n != head; n = n->down) {
-      /* try erasing all the columns covered by the row we picked */
-      for (x = n->next; x != n; x = x->next)
-         cover_col(x->head);
+   if (!matrix_fits((unsigned long)m->rows + rows, total))
+      return 0;
+   return matrix_grow(m, m->rows + rows, total);
+}
 
-      /* add the row into the solution for now... */
-      stack_push(solution, n);
+/* constructs a new DLX matrix with the given width; returns NULL if there
+ * isn't enough memory, or dlx_index can't number its headers */
+matrix *new_matrix(unsigned w) {
+   matrix *m = malloc(sizeof(matrix));
+   unsigned i;
+
+   if (!m)
+      return NULL;
+   if (!matrix_fits(0, w + 2UL)) {
+      free(m);
+      return NULL;
+   }
 
-      /* try to solve the modified matrix */
-      void **list;
-      if (list = matrix_solve_helper(m, solution, len))
-         return list;
+   m->w = w;
+   m->rows = 0;
+   m->row_cap = 0;
+   m->node_cap = 0;
+   m->base = 0;
+   m->depth = 0;
+   m->phase = PHASE_ENTER;
+   m->start = NULL;
+   m->top = NULL;
+   m->up = NULL;
+   m->down = NULL;
+
+   /* allocate the header list and the solution list; no solution can hold
+    * more rows than there are columns */
+   m->prev = malloc((w+1)*sizeof(dlx_index));
+   m->next = malloc((w+1)*sizeof(dlx_index));
+   m->size = malloc((w+1)*sizeof(dlx_index));
+   m->type = malloc((w+1)*sizeof(int));
+   m->sol = malloc((w+1)*sizeof(dlx_index));
+   m->out = malloc((w+1)*sizeof(unsigned));
+
+   /* allocate room for the headers and the first spacer */
+   if (!m->prev || !m->next || !m->size || !m->type || !m->sol || !m->out ||
+         !matrix_grow(m, 0, w+2)) {
+      free_matrix(m);
+      return NULL;
+   }
 
-      /* that didn't work... now we backtrack */
-      stack_pop(solution);
+   /* link the root and the headers into a circular list, with each header
+    * starting out as an empty column */
+   for (i = 0; i <= w; i++) {
+      m->prev[i] = i ? i-1 : w;
+      m->next[i] = i < w ? i+1 : 0;
+      m->size[i] = 0;
+      m->type[i] = 0;
+      m->top[i] = i;
+      m->up[i] = i;
+      m->down[i] = i;
+   }
+
+   /* the first spacer precedes row 0 */
+   m->top[w+1] = 0;
+   m->up[w+1] = w+1;
+   m->down[w+1] = w+1;
+   m->nodes = w+2;
+
+   /* default to plain minimum-remaining-values column selection */
+   m->pick = pick_mrv;
+   m->seed = 1;
+   m->visits = 0;
+   matrix_clear_stats(m);
+
+   return m;
+}
 
-      /* add everything we erased back into the matrix; this is easy since
-       * we kept track of the node we selected */
-      for (x = n->next; x != n; x = x->next)
-         uncover_col(x->head);
+/* inserts a row covering the given columns into the matrix, and returns its
+ * number; rows are numbered in the order they are added, and must cover at
+ * least one column. Returns MATRIX_NO_ROW if there isn't enough memory, or
+ * the row would need more nodes or rows than dlx_index and dlx_top can
+ * number. */
+unsigned matrix_add_row(matrix *m, unsigned pos[], unsigned len) {
+   /* the row's nodes and the spacer after it need indices */
+   if (!matrix_fits(m->rows + 1UL, (unsigned long)m->nodes + len + 1))
+      return MATRIX_NO_ROW;
+
+   /* make room for the row, doubling the arrays so that adding rows one at a
+    * time stays cheap */
+   if (m->rows == m->row_cap && !matrix_grow(m, 2*m->row_cap + 1, 0))
+      return MATRIX_NO_ROW;
+   if (m->nodes + len + 1 > m->node_cap &&
+         !matrix_grow(m, 0, 2*m->node_cap + len + 1))
+      return MATRIX_NO_ROW;
+
+   const dlx_index spacer = m->nodes - 1, first = m->nodes;
+   unsigned i;
+
+   /* append a node to the bottom of each column in the row */
+   for (i = 0; i < len; i++) {
+      const dlx_index x = m->nodes++, c = pos[i] + 1;
+      m->top[x] = c;
+      m->up[x] = m->up[c];
+      m->down[x] = c;
+      m->down[m->up[c]] = x;
+      m->up[c] = x;
+      m->size[c]++;
    }
 
-   /* no possible solutions for the column we picked... add it back into the
-    * matrix and return NULL for failure */
-   uncover_col(head);
+   /* point the preceding spacer at the end of the row, and terminate the row
+    * with a new spacer pointing back at its start */
+   m->down[spacer] = m->nodes - 1;
+   m->top[m->nodes] = -(dlx_top)(m->rows + 1);
+   m->up[m->nodes] = first;
+   m->down[m->nodes] = m->nodes;
+   m->nodes++;
 
-   return NULL;
+   m->start[m->rows] = first;
+   return m->rows++;
 }
 
-/* constructs a new DLX matrix with the given width */
-matrix *new_matrix(unsigned w) {
-   /* allocate matrix object and the list of nodes */
-   matrix *m = xmalloc(sizeof(matrix));
-   node **row = xmalloc(w * sizeof(node*));
+/* selects a row ahead of the search, as though it were part of every
+ * solution; returns 0 without changing anything if the row conflicts with a
+ * row already selected. Rows can't be selected while a search is in
+ * progress. */
+int matrix_select_row(matrix *m, unsigned row) {
+   const dlx_index r = m->start[row];
+   dlx_index q = r;
+
+   /* a row conflicts exactly when one of its columns is already covered */
+   do {
+      const dlx_index c = m->top[q];
+      if (m->next[m->prev[c]] != c)
+         return 0;
+      q = ROW_NEXT(m, q);
+   } while (q != r);
+
+   cover_col(m, m->top[r]);
+   cover_row(m, r);
+   m->sol[m->base++] = r;
+   m->depth = m->base;
+
+   return 1;
+}
 
-   /* allocate the first node in the header row */
-   node *first = xmalloc(sizeof(node));
-   node *curr = first, *prev = first;
+/* undoes the most recent matrix_select_row */
+void matrix_unselect_row(matrix *m) {
+   const dlx_index r = m->sol[--m->base];
+   uncover_row(m, r);
+   uncover_col(m, m->top[r]);
+   m->depth = m->base;
+}
 
-   /* allocate the header row */
-   int i;
-   for (i = 0; i < w; i++) {
-      curr->prev = prev;
-      prev->next = curr;
-      curr->up = curr;
-      curr->down = curr;
-      curr->head = curr;
-      row[i] = curr;
-      prev = curr;
-      curr = xmalloc(sizeof(node));
+/* picks the column the search would branch on next, and stores the numbers
+ * of the rows it could choose there into the given list, which needs room
+ * for one row per row of the matrix. Returns how many rows there are, or -1
+ * if every column is already covered by the selected rows. */
+int matrix_branches(matrix *m, unsigned *rows) {
+   dlx_index c, r;
+   int len = 0;
+
+   if (!m->next[0])
+      return -1;
+
+   c = get_col(m);
+   for (r = m->down[c]; r != c; r = m->down[r])
+      rows[len++] = row_of(m, r);
+
+   return len;
+}
+
+/* backs out of any search in progress, leaving just the selected rows
+ * covered, so the next search starts from the beginning */
+void matrix_rewind(matrix *m) {
+   /* levels below the current one have their column and row covered */
+   while (m->depth > m->base) {
+      const dlx_index r = m->sol[--m->depth];
+      uncover_row(m, r);
+      uncover_col(m, m->top[r]);
    }
+   m->phase = PHASE_ENTER;
+}
 
-   /* finish linking things up */
-   prev->next = curr;
-   curr->prev = prev;
-   first->prev = curr;
-   curr->next = first;
+/* undoes every matrix_select_row, restoring the matrix as it was built */
+void matrix_reset(matrix *m) {
+   matrix_rewind(m);
+   m->depth = 0;
+   while (m->base) {
+      const dlx_index r = m->sol[--m->base];
+      uncover_row(m, r);
+      uncover_col(m, m->top[r]);
+   }
+}
 
-   /* set the root node to it's proper place */
-   m->root = curr;
+/* returns the number of rows in the matrix */
+unsigned matrix_rows(matrix *m) {
+   return m->rows;
+}
 
-   /* set the current row of nodes to the header */
-   m->row = row;
+/* tags a column with a constraint type, used by PICK_MRV_TYPE */
+void matrix_set_col_type(matrix *m, unsigned col, int type) {
+   m->type[col+1] = type;
+}
 
-   return m;
+/* selects the column selection strategy used by the search; the seed is only
+ * used by PICK_MRV_RANDOM */
+void matrix_set_strategy(matrix *m, pick_strategy s, unsigned long seed) {
+   switch (s) {
+   case PICK_MRV_TYPE:
+      m->pick = pick_mrv_type;
+      break;
+   case PICK_MRV_RANDOM:
+      m->pick = pick_mrv_random;
+      break;
+   default:
+      m->pick = pick_mrv;
+      break;
+   }
+   m->seed = seed;
 }
 
-/* inserts a row into the matrix with an associated object */
-void matrix_add_row(matrix *m, void *r, unsigned pos[], unsigned len) {
-   node *first = xmalloc(sizeof(node));
-   first->r = r;
+/* orders node indices, for qsort */
+int by_index(const void *a, const void *b) {
+   const dlx_index x = *(const dlx_index *)a, y = *(const dlx_index *)b;
+   return x < y ? -1 : x > y;
+}
 
-   node *curr = first, *prev = curr;
+/* puts the rows of every column in a random order, which the search tries
+ * them in; the same seed always gives the same order, whatever order the
+ * columns were in before. Rows can't be shuffled while any are selected or
+ * a search is in progress. Returns 0 if there isn't enough memory. */
+int matrix_shuffle(matrix *m, unsigned long seed) {
+   dlx_index *list = malloc((m->rows + 1)*sizeof(dlx_index));
+   dlx_index c, p, t;
+   unsigned len, i, j;
+
+   if (!list)
+      return 0;
+
+   for (c = 1; c <= m->w; c++) {
+      /* start from the order the rows were added in */
+      len = 0;
+      for (p = m->down[c]; p != c; p = m->down[p])
+         list[len++] = p;
+      qsort(list, len, sizeof(dlx_index), by_index);
+
+      /* shuffle them, then link them back up in that order */
+      for (i = len; i > 1; i--) {
+         seed = seed * 1103515245UL + 12345UL;
+         j = (seed >> 16) % i;
+         t = list[i-1];
+         list[i-1] = list[j];
+         list[j] = t;
+      }
+      for (p = c, i = 0; i < len; p = list[i++]) {
+         m->down[p] = list[i];
+         m->up[list[i]] = p;
+      }
+      m->down[p] = c;
+      m->up[c] = p;
+   }
 
-   /* for each position, allocate a new node and attach it to all it's
-    * neighbors */
-   int i;
-   for (i = 0; i < len; i++) {
-      /* this is sort of voodoo but it works perfectly */
-      node *x = m->row[pos[i]];
-
-      curr->prev = prev;
-      prev->next = curr;
-      curr->up = x;
-      curr->down = x->down;
-      curr->head = x->head;
-      x->down = curr;
-      curr->down->up = curr;
-
-      m->row[pos[i]] = curr;
-      prev = curr;
-      curr = xmalloc(sizeof(node));
-      curr->r = r;
+   free(list);
+   return 1;
+}
+
+/* runs the search until it finds a solution, runs out of possibilities, or
+ * has entered budget levels (budget 0 means no limit). A paused search picks
+ * up where it stopped on the next call, and a search that found a solution
+ * moves on to the next one; the matrix can be handed between threads in
+ * between calls. */
+search_status matrix_search(matrix *m, unsigned long budget) {
+   unsigned long visits = 0;
+   unsigned depth = m->depth;
+   dlx_index c, r;
+
+   for (;;) {
+      switch (m->phase) {
+      case PHASE_ENTER:
+         /* stop here if we're out of budget, so resuming re-enters */
+         if (budget && visits == budget) {
+            m->depth = depth;
+            m->visits = visits;
+            return SEARCH_PAUSED;
+         }
+         visits++;
+
+         /* if the root node is the only node left, we're done; the next
+          * call backtracks from here to find another solution */
+         if (!m->next[0]) {
+            m->depth = depth;
+            m->visits = visits;
+            m->phase = PHASE_LEAVE;
+            return SEARCH_FOUND;
+         }
+
+         /* pick a column, eliminate it, and start on its first row */
+         c = get_col(m);
+#ifdef DLX_STATS
+         {
+            const unsigned d = depth - m->base;
+            const unsigned i = d < STATS_DEPTH ? d : STATS_DEPTH - 1;
+            m->stats.nodes++;
+            m->stats.picks[i]++;
+            m->stats.branches[i] += m->size[c];
+            if (d + 1 > m->stats.max_depth)
+               m->stats.max_depth = d + 1;
+         }
+#endif
+         cover_col(m, c);
+         m->sol[depth] = m->down[c];
+         m->phase = PHASE_TRY;
+         break;
+
+      case PHASE_TRY:
+         r = m->sol[depth];
+
+         if (r <= m->w) {
+            /* we've wrapped around to the header, so there are no possible
+             * solutions for the column we picked... add it back into the
+             * matrix and backtrack */
+            uncover_col(m, r);
+            STAT(m->stats.backtracks++);
+            m->phase = PHASE_LEAVE;
+         } else {
+            /* erase all the columns covered by the row and go down a level
+             * with the row in the solution for now... */
+            cover_row(m, r);
+            STAT(m->stats.rows++);
+            depth++;
+            m->phase = PHASE_ENTER;
+         }
+         break;
+
+      case PHASE_LEAVE:
+         /* if we're back to the selected rows, we've tried everything */
+         if (depth == m->base) {
+            m->depth = depth;
+            m->visits = visits;
+            m->phase = PHASE_DONE;
+            return SEARCH_EXHAUSTED;
+         }
+
+         /* add everything the level above erased back into the matrix, and
+          * move it on to its next row; this is easy since we kept track of
+          * the node it selected */
+         r = m->sol[--depth];
+         uncover_row(m, r);
+         m->sol[depth] = m->down[r];
+         m->phase = PHASE_TRY;
+         break;
+
+      default:
+         m->visits = 0;
+         return SEARCH_EXHAUSTED;
+      }
    }
+}
 
-   /* XXX this is sloppy, how about we just dont xmalloc it at all... */
-   free(curr);
+/* returns how many levels the last matrix_search entered */
+unsigned long matrix_visits(matrix *m) {
+   return m->visits;
+}
 
-   /* finish linking things up */
-   prev->next = first;
-   first->prev = prev;
+/* stores the numbers of the rows in the solution the search just found,
+ * including any selected rows, into the given list, and returns how many
+ * there are; the list needs room for one row per column */
+int matrix_solution(matrix *m, unsigned *rows) {
+   unsigned i;
+   for (i = 0; i < m->depth; i++)
+      rows[i] = row_of(m, m->sol[i]);
+   return m->depth;
 }
 
-/* wraps the matrix_solve_helper function to solve the exact cover problem
- * represented by the DLX matrix */
-void **matrix_solve(matrix *m, int *len) {
-   stack *s = new_stack();
-   void **soln = matrix_solve_helper(m, s, len);
-   free_stack(s);
-   return soln;
+/* the time in seconds on a clock that only goes forward, for deadlines */
+double search_clock(void) {
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-/* frees a matrix object */
-void free_matrix(matrix *m) {
-   /* free the list of nodes at the bottom of the columns */
-   free(m->row);
-
-   /* loop over the headers */
-   node *head = m->root->next;
-   while (head != m->root) {
-      node *next = head->next;
-
-      /* free all the nodes in the column */
-      node *n = head->down;
-      while (n != head) {
-         node *down = n->down;
-         free(n);
-         n = down;
+/* solves the exact cover problem represented by the DLX matrix, storing the
+ * numbers of the rows in the solution into the given list as described for
+ * matrix_solution. Returns the number of rows in the solution, -1 if there
+ * isn't one, or MATRIX_GAVE_UP if the search ran past one of the limits
+ * (which may be NULL); the clock is only looked at every LIMIT_SLICE
+ * levels. The matrix is left as it was before the call either way. */
+int matrix_solve(matrix *m, unsigned *rows, const search_limits *limits) {
+   search_status st;
+   int len = -1;
+
+   matrix_rewind(m);
+   if (!limits || (!limits->nodes && !limits->seconds)) {
+      st = matrix_search(m, 0);
+   } else {
+      const double deadline = limits->seconds ?
+            search_clock() + limits->seconds : 0;
+      unsigned long used = 0;
+
+      /* search a slice at a time, stopping at whichever limit comes
+       * first */
+      for (;;) {
+         unsigned long slice = LIMIT_SLICE;
+         if (limits->nodes && limits->nodes - used < slice)
+            slice = limits->nodes - used;
+
+         st = matrix_search(m, slice);
+         if (st != SEARCH_PAUSED)
+            break;
+
+         used += slice;
+         if ((limits->nodes && used >= limits->nodes) ||
+               (deadline && search_clock() >= deadline))
+            break;
       }
+   }
+
+   if (st == SEARCH_FOUND)
+      len = matrix_solution(m, rows);
+   else if (st == SEARCH_PAUSED)
+      len = MATRIX_GAVE_UP;
+   matrix_rewind(m);
+
+   return len;
+}
+
+/* runs the search from the beginning and hands each solution to visit as it
+ * is found, along with ctx, stopping after limit solutions (0 means no
+ * limit) or as soon as visit returns nonzero; visit may be NULL to just
+ * count. The rows passed to visit are only valid during the call. Returns
+ * the number of solutions found, and leaves the matrix as it was before. */
+unsigned long matrix_enumerate(matrix *m, unsigned long limit,
+      matrix_visit visit, void *ctx) {
+   unsigned long count = 0;
+
+   matrix_rewind(m);
+   while ((!limit || count < limit) && matrix_search(m, 0) == SEARCH_FOUND) {
+      count++;
+      if (visit && visit(ctx, m->out, matrix_solution(m, m->out)))
+         break;
+   }
+   matrix_rewind(m);
+
+   return count;
+}
 
-      /* free the header */
-      free(head);
+/* duplicates a matrix, including its selected rows, so that it can be
+ * searched independently; the matrix can't have a search in progress */
+matrix *matrix_copy(matrix *m) {
+   matrix *c = xmalloc(sizeof(matrix));
+   const unsigned w = m->w + 1;
+
+   *c = *m;
+   c->node_cap = m->nodes;
+   c->row_cap = m->rows;
+
+   c->prev = xmalloc(w*sizeof(dlx_index));
+   c->next = xmalloc(w*sizeof(dlx_index));
+   c->size = xmalloc(w*sizeof(dlx_index));
+   c->type = xmalloc(w*sizeof(int));
+   c->sol = xmalloc(w*sizeof(dlx_index));
+   c->out = xmalloc(w*sizeof(unsigned));
+   c->top = xmalloc(m->nodes*sizeof(dlx_top));
+   c->up = xmalloc(m->nodes*sizeof(dlx_index));
+   c->down = xmalloc(m->nodes*sizeof(dlx_index));
+   c->start = xmalloc((m->rows ? m->rows : 1)*sizeof(dlx_index));
+
+   memcpy(c->prev, m->prev, w*sizeof(dlx_index));
+   memcpy(c->next, m->next, w*sizeof(dlx_index));
+   memcpy(c->size, m->size, w*sizeof(dlx_index));
+   memcpy(c->type, m->type, w*sizeof(int));
+   memcpy(c->sol, m->sol, w*sizeof(dlx_index));
+   memcpy(c->top, m->top, m->nodes*sizeof(dlx_top));
+   memcpy(c->up, m->up, m->nodes*sizeof(dlx_index));
+   memcpy(c->down, m->down, m->nodes*sizeof(dlx_index));
+   memcpy(c->start, m->start, m->rows*sizeof(dlx_index));
+   matrix_clear_stats(c);
+
+   return c;
+}
+
+/* returns the effort counters of the searches since they were last
+ * cleared, or NULL if they aren't built in */
+search_stats *matrix_stats(matrix *m) {
+#ifdef DLX_STATS
+   return &m->stats;
+#else
+   return NULL;
+#endif
+}
+
+/* zeroes the effort counters */
+void matrix_clear_stats(matrix *m) {
+   memset(&m->stats, 0, sizeof(search_stats));
+}
 
-      head = next;
+/* adds one set of counters to another, as though both searches were one */
+void stats_add(search_stats *to, const search_stats *from) {
+   int i;
+
+   to->nodes += from->nodes;
+   to->rows += from->rows;
+   to->backtracks += from->backtracks;
+   to->covers += from->covers;
+   if (from->max_depth > to->max_depth)
+      to->max_depth = from->max_depth;
+   for (i = 0; i < STATS_DEPTH; i++) {
+      to->picks[i] += from->picks[i];
+      to->branches[i] += from->branches[i];
    }
+}
 
-   /* free the root node and the matrix itself */
-   free(m->root);
+/* frees a matrix object */
+void free_matrix(matrix *m) {
+   free(m->prev);
+   free(m->next);
+   free(m->size);
+   free(m->type);
+   free(m->sol);
+   free(m->out);
+   free(m->top);
+   free(m->up);
+   free(m->down);
+   free(m->start);
    free(m);
 }
@@ -29,12 +29,95 @@
 #ifndef MATRIX_H_GUARD
 #define MATRIX_H_GUARD
 
+#include <stdint.h>
+
+/* node indices; 16 bits are enough for boards up to 16x16 and halve the
+ * size of the link arrays, but larger boards need 32. A matrix refuses to
+ * grow past the nodes and rows its indices can number. */
+#ifdef DLX_INDEX16
+typedef uint16_t dlx_index;
+typedef int16_t dlx_top;
+#define DLX_MAX_ROWS INT16_MAX
+#else
+typedef uint32_t dlx_index;
+typedef int32_t dlx_top;
+#define DLX_MAX_ROWS INT32_MAX
+#endif
+#define DLX_MAX_NODES ((dlx_index)-1)
+
 typedef struct matrix matrix;
-typedef struct node node;
+
+/* levels of the search that get their own branching counts; deeper levels
+ * are counted along with the last one */
+#define STATS_DEPTH 64
+
+/* counters describing how much work a search took; they are only kept when
+ * built with -DDLX_STATS, so that the search pays nothing for them
+ * otherwise. Levels are counted from the first level below the selected
+ * rows. */
+typedef struct search_stats {
+   unsigned long nodes;      /* levels of the search entered */
+   unsigned long rows;       /* rows tried */
+   unsigned long backtracks; /* columns that ran out of rows to try */
+   unsigned long covers;     /* calls to cover_col */
+   unsigned max_depth;       /* deepest level a column was picked at */
+   unsigned long picks[STATS_DEPTH];    /* columns picked at each level */
+   unsigned long branches[STATS_DEPTH]; /* rows in the columns picked */
+} search_stats;
+
+/* outcomes of matrix_search */
+typedef enum search_status {
+   SEARCH_FOUND,     /* found a solution */
+   SEARCH_EXHAUSTED, /* there are no more solutions */
+   SEARCH_PAUSED     /* ran out of budget, call again to carry on */
+} search_status;
+
+/* limits on how long a search may run before giving up; zero means no
+ * limit */
+typedef struct search_limits {
+   unsigned long nodes; /* most levels of the search to enter */
+   double seconds;      /* most wall-clock time to take */
+} search_limits;
+
+/* what matrix_add_row returns when it runs out of memory */
+#define MATRIX_NO_ROW ((unsigned)-1)
+
+/* what matrix_solve returns when it gives up */
+#define MATRIX_GAVE_UP -2
+
+/* receives each solution found by matrix_enumerate; returns nonzero to stop */
+typedef int (*matrix_visit)(void *ctx, const unsigned *rows, int len);
+
+/* column selection strategies for the search */
+typedef enum pick_strategy {
+   PICK_MRV,       /* first column with the fewest nodes */
+   PICK_MRV_TYPE,  /* fewest nodes, ties broken by lowest column type */
+   PICK_MRV_RANDOM /* fewest nodes, ties broken at random */
+} pick_strategy;
 
 matrix *new_matrix(unsigned w);
+matrix *matrix_copy(matrix *m);
+search_stats *matrix_stats(matrix *m);
+void matrix_clear_stats(matrix *m);
+void stats_add(search_stats *to, const search_stats *from);
 void free_matrix(matrix *m);
-void matrix_add_row(matrix *m, void *r, unsigned pos[], unsigned len);
-void **matrix_solve(matrix *m, int *len);
+int matrix_reserve(matrix *m, unsigned rows, unsigned nodes);
+unsigned matrix_rows(matrix *m);
+unsigned matrix_add_row(matrix *m, unsigned pos[], unsigned len);
+int matrix_select_row(matrix *m, unsigned row);
+void matrix_unselect_row(matrix *m);
+int matrix_branches(matrix *m, unsigned *rows);
+void matrix_rewind(matrix *m);
+void matrix_reset(matrix *m);
+void matrix_set_col_type(matrix *m, unsigned col, int type);
+void matrix_set_strategy(matrix *m, pick_strategy s, unsigned long seed);
+int matrix_shuffle(matrix *m, unsigned long seed);
+search_status matrix_search(matrix *m, unsigned long budget);
+unsigned long matrix_visits(matrix *m);
+int matrix_solution(matrix *m, unsigned *rows);
+int matrix_solve(matrix *m, unsigned *rows, const search_limits *limits);
+double search_clock(void);
+unsigned long matrix_enumerate(matrix *m, unsigned long limit,
+      matrix_visit visit, void *ctx);
 
 #endif
@@ -0,0 +1,74 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef OPTIONS_H_GUARD
+#define OPTIONS_H_GUARD
+
+#include "matrix.h"
+
+/* solving backends */
+typedef enum backend {
+   BACKEND_DLX,      /* dancing links, for any board */
+   BACKEND_BITBOARD, /* candidate bitmasks, for 9x9 boards */
+   BACKEND_LOCKSTEP  /* singles on many 9x9 boards at once, then dlx */
+} backend;
+
+/* ways of reporting results */
+typedef enum format {
+   FORMAT_FULL,     /* human-readable report of every puzzle */
+   FORMAT_LINE,     /* one line per puzzle: the solution, or the outcome */
+   FORMAT_SOLUTION, /* one line per solved puzzle, with just the solution */
+   FORMAT_FAILURES, /* one line per puzzle that wasn't solved */
+   FORMAT_BINARY    /* a packed results file, see packed.c */
+} format;
+
+/* settings collected from the command line */
+typedef struct options {
+   int k;                   /* order of the boards */
+   backend engine;          /* how to solve them */
+   pick_strategy strategy;  /* column selection strategy */
+   unsigned long seed;      /* seed for the random strategy */
+   int count;               /* count solutions instead of printing one */
+   unsigned long limit;     /* stop counting here, 0 means no limit */
+   int jobs;                /* number of worker threads */
+   int split;               /* use the threads within each puzzle */
+   format style;            /* how to report the results */
+   int flush;               /* flush the output after this many puzzles; 0
+                             * waits for the buffer to fill, and -1 picks 1
+                             * for stdin and 0 for files */
+   int stats;               /* report the effort each search took */
+   search_limits limits;    /* when to give up on a puzzle */
+   struct cache *cache;     /* answers to puzzles seen before, or NULL */
+   int clues;               /* clues to leave in generated puzzles, 0 for
+                             * as few as possible */
+   int convert;             /* copy the puzzles across instead of solving
+                             * them, packed or as text */
+} options;
+
+#endif
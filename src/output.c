@@ -0,0 +1,142 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "xmalloc.h"
+#include "output.h"
+
+/* Reports are formatted straight into a large buffer, which is written out
+ * with a single write() whenever it fills up, instead of going through
+ * stdio a character at a time. */
+
+/* a buffered output file descriptor */
+struct writer {
+   int fd;
+   char *buf;
+   size_t len;     /* bytes waiting in the buffer */
+   size_t cap;     /* size of the buffer */
+   size_t written; /* bytes written out so far */
+   off_t base;     /* offset in the file we started at, or -1 if we
+                    * can't seek back to patch what we wrote */
+};
+
+/* sets up a writer for an open file descriptor */
+writer *new_writer(int fd) {
+   writer *w = xmalloc(sizeof(writer));
+   const int flags = fcntl(fd, F_GETFL);
+   w->fd = fd;
+   w->cap = OUTPUT_SIZE;
+   w->buf = xmalloc(w->cap);
+   w->len = 0;
+   w->written = 0;
+   w->base = flags < 0 || (flags & O_APPEND) ? -1 : lseek(fd, 0, SEEK_CUR);
+   return w;
+}
+
+/* writes out everything in the buffer; returns -1 if the write failed */
+int writer_flush(writer *w) {
+   size_t done = 0;
+
+   while (done < w->len) {
+      const ssize_t got = write(w->fd, w->buf + done, w->len - done);
+      if (got < 0) {
+         if (errno == EINTR)
+            continue;
+         w->len = 0;
+         return -1;
+      }
+      done += got;
+   }
+
+   w->written += w->len;
+   w->len = 0;
+   return 0;
+}
+
+/* returns room for len bytes at the end of the buffer, flushing it first if
+ * need be; writer_commit says how much of the room was used */
+char *writer_reserve(writer *w, size_t len) {
+   if (w->len + len > w->cap) {
+      writer_flush(w);
+      if (len > w->cap)
+         w->buf = xrealloc(w->buf, (w->cap = len));
+   }
+   return w->buf + w->len;
+}
+
+/* adds len bytes written into the room from writer_reserve to the buffer */
+void writer_commit(writer *w, size_t len) {
+   w->len += len;
+}
+
+/* adds a block of data to the buffer */
+void writer_write(writer *w, const char *data, size_t len) {
+   memcpy(writer_reserve(w, len), data, len);
+   writer_commit(w, len);
+}
+
+/* adds a string to the buffer */
+void writer_puts(writer *w, const char *s) {
+   writer_write(w, s, strlen(s));
+}
+
+/* the number of bytes that have gone through the writer so far */
+size_t writer_tell(writer *w) {
+   return w->written + w->len;
+}
+
+/* overwrites len bytes that went through the writer, starting from where
+ * writer_tell was at, once everything before them has been written out;
+ * returns 0 if the output can't be seeked, like a pipe, or the write
+ * failed */
+int writer_patch(writer *w, size_t at, const char *data, size_t len) {
+   ssize_t got;
+
+   if (w->base < 0 || writer_flush(w) ||
+         lseek(w->fd, w->base + at, SEEK_SET) < 0)
+      return 0;
+   do {
+      got = write(w->fd, data, len);
+   } while (got < 0 && errno == EINTR);
+   lseek(w->fd, w->base + w->written, SEEK_SET);
+   return got == (ssize_t)len;
+}
+
+/* flushes and frees a writer, leaving its file descriptor open */
+void free_writer(writer *w) {
+   writer_flush(w);
+   free(w->buf);
+   free(w);
+}
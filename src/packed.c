@@ -0,0 +1,145 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "packed.h"
+
+/* A packed file starts with a header of PACKED_HEADER bytes:
+ *
+ *    0  "CDKP", to tell it apart from text
+ *    4  format version, 1
+ *    5  kind of records, 'P' for puzzles or 'R' for results
+ *    6  board order k
+ *    7  bits per cell
+ *    8  number of records, 64-bit little-endian, or all ones if unknown
+ *
+ * Every record after it is the same size, so record i starts at
+ * PACKED_HEADER + i * packed_record_size. The n*n cells of a grid are
+ * packed in row-major order into just enough bits to hold 0 (empty) to n,
+ * most significant bit first, and the last byte is padded with zeroes:
+ * four bits per cell and 41 bytes per grid for 9x9 boards. A results
+ * record is one byte of packed_status followed by the cells of the
+ * solution, which are all 0 unless it was solved. */
+
+#define PACKED_MAGIC "CDKP"
+#define PACKED_VERSION 1
+
+/* the number of bits needed for each cell of a board of order k */
+int packed_bits(int k) {
+   const int n = k*k;
+   int bits = 1;
+   while ((1 << bits) <= n)
+      bits++;
+   return bits;
+}
+
+/* the size of a packed grid of order k */
+size_t packed_cells_size(int k) {
+   return ((size_t)k*k*k*k*packed_bits(k) + 7) / 8;
+}
+
+/* the size of each record in a packed file of order k */
+size_t packed_record_size(int k, packed_kind kind) {
+   return packed_cells_size(k) + (kind == PACKED_RESULTS);
+}
+
+/* writes the PACKED_HEADER bytes of a header into buf */
+void packed_header(char *buf, int k, packed_kind kind, uint64_t count) {
+   int i;
+
+   memcpy(buf, PACKED_MAGIC, 4);
+   buf[4] = PACKED_VERSION;
+   buf[5] = kind;
+   buf[6] = k;
+   buf[7] = packed_bits(k);
+   for (i = 0; i < 8; i++)
+      buf[8+i] = (char)(count >> 8*i);
+}
+
+/* reads the PACKED_HEADER bytes of a header from buf; returns 0 if they
+ * aren't a header this version can read */
+int packed_read_header(const char *buf, int *k, packed_kind *kind,
+      uint64_t *count) {
+   const unsigned char *b = (const unsigned char *)buf;
+   int i;
+
+   if (memcmp(buf, PACKED_MAGIC, 4) || b[4] != PACKED_VERSION ||
+         (b[5] != PACKED_PUZZLES && b[5] != PACKED_RESULTS) ||
+         b[6] < 1 || b[6] > 8 || b[7] != packed_bits(b[6]))
+      return 0;
+
+   *kind = b[5];
+   *k = b[6];
+   *count = 0;
+   for (i = 7; i >= 0; i--)
+      *count = *count << 8 | b[8+i];
+   return 1;
+}
+
+/* packs the cells of a grid of order k into packed_cells_size bytes; each
+ * is cut down to the bits a cell has, so 0xff packs as all ones, which is
+ * out of range for every order but 1 */
+void pack_cells(int k, const uint8_t *grid, char *out) {
+   const int cells = k*k*k*k, bits = packed_bits(k);
+   const unsigned mask = (1u << bits) - 1;
+   unsigned char *p = (unsigned char *)out;
+   unsigned acc = 0;
+   int i, have = 0;
+
+   for (i = 0; i < cells; i++) {
+      acc = acc << bits | (grid[i] & mask);
+      have += bits;
+      if (have >= 8) {
+         have -= 8;
+         *p++ = acc >> have;
+      }
+   }
+   if (have)
+      *p = acc << (8 - have);
+}
+
+/* unpacks the cells of a grid of order k from packed_cells_size bytes;
+ * returns 0 if any cell is out of range */
+int unpack_cells(int k, const char *in, uint8_t *grid) {
+   const int n = k*k, cells = n*n, bits = packed_bits(k);
+   const unsigned mask = (1u << bits) - 1;
+   const unsigned char *p = (const unsigned char *)in;
+   unsigned acc = 0, bad = 0;
+   int i, have = 0;
+
+   for (i = 0; i < cells; i++) {
+      if (have < bits) {
+         acc = acc << 8 | *p++;
+         have += 8;
+      }
+      have -= bits;
+      grid[i] = (acc >> have) & mask;
+      bad |= grid[i] > n;
+   }
+   return !bad;
+}
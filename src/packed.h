@@ -26,70 +26,40 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
-#include <stdlib.h>
-#include "xmalloc.h"
-#include "stack.h"
+#ifndef PACKED_H_GUARD
+#define PACKED_H_GUARD
 
-/* item in a stack, with a corresponding data object */
-struct stack_node {
-   void *item;
-   struct stack_node *prev;
-};
+#include <stddef.h>
+#include <stdint.h>
 
-/* stack itself, which holds the top node and it's size */
-struct stack {
-   stack_node *top;
-   unsigned size;
-};
+/* size of the header at the start of a packed file */
+#define PACKED_HEADER 16
 
-/* allocates a new stack */
-stack *new_stack(void) {
-   stack *s = xmalloc(sizeof(stack));
+/* record count of a packed file whose length wasn't known when its header
+ * was written; its records run to the end of the file */
+#define PACKED_UNKNOWN (~(uint64_t)0)
 
-   /* empty... for now */
-   s->top = NULL;
-   s->size = 0;
+/* what the records of a packed file hold */
+typedef enum packed_kind {
+   PACKED_PUZZLES = 'P', /* the cells of a puzzle */
+   PACKED_RESULTS = 'R'  /* an outcome, then the cells of the solution */
+} packed_kind;
 
-   return s;
-}
+/* outcomes in the records of a packed results file */
+typedef enum packed_status {
+   PACKED_SOLVED,      /* the cells hold the solution */
+   PACKED_NO_SOLUTION, /* the puzzle has no solution; the cells are 0 */
+   PACKED_GAVE_UP,     /* the search ran past its limits */
+   PACKED_INVALID      /* the puzzle couldn't be read */
+} packed_status;
 
-/* place an item on top of the stack */
-void stack_push(stack *s, void *item) {
-   stack_node *n = xmalloc(sizeof(stack_node));
+int packed_bits(int k);
+size_t packed_cells_size(int k);
+size_t packed_record_size(int k, packed_kind kind);
+void packed_header(char *buf, int k, packed_kind kind, uint64_t count);
+int packed_read_header(const char *buf, int *k, packed_kind *kind,
+      uint64_t *count);
+void pack_cells(int k, const uint8_t *grid, char *out);
+int unpack_cells(int k, const char *in, uint8_t *grid);
 
-   /* set up new node */
-   n->prev = s->top;
-   n->item = item;
-
-   /* replace top node and increase size */
-   s->size++;
-   s->top = n;
-}
-
-/* removes the item on top of the stack */
-void *stack_pop(stack *s) {
-   /* get the top item and it's data object */
-   stack_node *tmp = s->top;
-   void *item = tmp->item;
-
-   /* replace the top node with the one under and decrease size */
-   s->top = tmp->prev;
-   s->size--;
-
-   /* free the old top node and return the date */
-   free(tmp);
-   return item;
-}
-
-/* deallocates a stack */
-void free_stack(stack *s) {
-   /* pop everything off and free */
-   while (s->size)
-      stack_pop(s);
-   free(s);
-}
-
-/* retrieve the size of the stack */
-int stack_size(stack *s) {
-   return s->size;
-}
+#endif
@@ -0,0 +1,328 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "xmalloc.h"
+#include "matrix.h"
+#include "parallel.h"
+
+/* how many levels of the search tree may be split into separate tasks */
+#define SPLIT_DEPTH 3
+
+/* how many tasks to aim for per worker */
+#define TASKS_PER_JOB 4
+
+/* how many nodes a worker visits between checks for cancellation */
+#define SLICE 4096
+
+/* a branch of the search tree: the rows chosen on the way down to it */
+typedef struct task {
+   unsigned rows[SPLIT_DEPTH];
+   int len;
+} task;
+
+/* a worker's queue of tasks; the owner takes tasks from the back, and idle
+ * workers steal them from the front */
+typedef struct deque {
+   pthread_mutex_t lock;
+   task *tasks;
+   unsigned front, back;
+} deque;
+
+/* state shared between the workers */
+typedef struct split {
+   matrix *m;          /* the matrix with the puzzle's rows selected */
+   deque *queues;
+   int jobs;
+   pthread_mutex_t lock;
+   int found;          /* set once any worker finds a solution */
+   int gave_up;        /* set once the search runs past its limits */
+   unsigned long nodes;   /* node budget shared by the workers, or 0 */
+   unsigned long used;    /* levels entered by the workers so far */
+   double deadline;       /* when to give up, or 0 */
+   int len;            /* length of the solution */
+   unsigned *rows;     /* where the solution goes */
+   search_stats stats; /* the workers' effort, with -DDLX_STATS */
+} split;
+
+/* a worker and the shared state it belongs to */
+typedef struct worker {
+   split *sp;
+   int id;
+} worker;
+
+/* takes a task from the worker's own queue, or steals one from another
+ * worker's; returns 0 once every queue is empty */
+int next_task(split *sp, int id, task *t) {
+   int i, got = 0;
+
+   for (i = 0; i < sp->jobs && !got; i++) {
+      deque *q = &sp->queues[(id + i) % sp->jobs];
+
+      pthread_mutex_lock(&q->lock);
+      if (q->front < q->back) {
+         *t = i ? q->tasks[q->front++] : q->tasks[--q->back];
+         got = 1;
+      }
+      pthread_mutex_unlock(&q->lock);
+   }
+
+   return got;
+}
+
+/* checks whether some worker has already found a solution, or the search
+ * has run past its limits */
+int cancelled(split *sp) {
+   pthread_mutex_lock(&sp->lock);
+   const int stop = sp->found || sp->gave_up;
+   pthread_mutex_unlock(&sp->lock);
+   return stop;
+}
+
+/* takes the next slice of a worker's search out of the limits, giving up
+ * once they're used up; returns how many levels the worker may enter, or 0
+ * if it should stop like cancelled. A slice is reserved up front, so the
+ * workers together never enter more levels than the node limit allows, and
+ * near the limit it's shared out between them. */
+unsigned long reserve(split *sp) {
+   unsigned long slice = SLICE;
+
+   pthread_mutex_lock(&sp->lock);
+   if (!sp->found && !sp->gave_up) {
+      if ((sp->nodes && sp->used >= sp->nodes) ||
+            (sp->deadline && search_clock() >= sp->deadline))
+         sp->gave_up = 1;
+      else if (sp->nodes && (sp->nodes - sp->used)/sp->jobs < slice)
+         slice = (sp->nodes - sp->used)/sp->jobs
+               ? (sp->nodes - sp->used)/sp->jobs : 1;
+   }
+   if (sp->found || sp->gave_up)
+      slice = 0;
+   sp->used += slice;
+   pthread_mutex_unlock(&sp->lock);
+   return slice;
+}
+
+/* gives back the part of a slice a worker's search didn't use */
+void refund(split *sp, unsigned long unused) {
+   pthread_mutex_lock(&sp->lock);
+   sp->used -= unused;
+   pthread_mutex_unlock(&sp->lock);
+}
+
+/* worker thread: searches the branches of its tasks on its own copy of the
+ * matrix until a solution turns up or there is nothing left to do */
+void *split_worker(void *arg) {
+   worker *w = arg;
+   split *sp = w->sp;
+   matrix *m = matrix_copy(sp->m);
+   unsigned long slice;
+   task t;
+   int i;
+
+   while (!cancelled(sp) && next_task(sp, w->id, &t)) {
+      search_status st = SEARCH_PAUSED;
+
+      /* go down to the task's branch */
+      for (i = 0; i < t.len; i++)
+         matrix_select_row(m, t.rows[i]);
+
+      /* search it a slice at a time, charging each slice for the levels it
+       * really entered, so we notice when to give up */
+      while ((slice = reserve(sp))) {
+         st = matrix_search(m, slice);
+         refund(sp, slice - matrix_visits(m));
+         if (st != SEARCH_PAUSED)
+            break;
+      }
+
+      if (st == SEARCH_FOUND) {
+         pthread_mutex_lock(&sp->lock);
+         if (!sp->found) {
+            sp->found = 1;
+            sp->len = matrix_solution(m, sp->rows);
+         }
+         pthread_mutex_unlock(&sp->lock);
+      }
+
+      /* come back up for the next task */
+      matrix_rewind(m);
+      for (i = 0; i < t.len; i++)
+         matrix_unselect_row(m);
+   }
+
+   /* count this worker's effort along with the rest of the search */
+   if (matrix_stats(m)) {
+      pthread_mutex_lock(&sp->lock);
+      stats_add(&sp->stats, matrix_stats(m));
+      pthread_mutex_unlock(&sp->lock);
+   }
+
+   free_matrix(m);
+   return NULL;
+}
+
+/* splits the search into at least TASKS_PER_JOB tasks per worker where
+ * possible, by expanding the branches of the search tree a level at a time,
+ * each expansion counting as a level entered against the node limit;
+ * returns the number of tasks, or -1 if a solution turned up on the way,
+ * in which case it's stored in sp */
+int make_tasks(split *sp, task **out) {
+   matrix *m = sp->m;
+   unsigned *branch = xmalloc(matrix_rows(m)*sizeof(unsigned));
+   task *tasks = xmalloc(sizeof(task));
+   int count = 1, depth, i, j;
+
+   tasks[0].len = 0;
+
+   for (depth = 0; depth < SPLIT_DEPTH && count < TASKS_PER_JOB*sp->jobs;
+         depth++) {
+      task *next = NULL;
+      int next_count = 0;
+
+      for (i = 0; i < count; i++) {
+         /* go down to the task's branch, and look at the rows below it */
+         for (j = 0; j < tasks[i].len; j++)
+            matrix_select_row(m, tasks[i].rows[j]);
+         const int b = matrix_branches(m, branch);
+         sp->used++;
+
+         if (b < 0) {
+            /* nothing left to cover, so this branch is a solution */
+            sp->found = 1;
+            sp->len = matrix_solution(m, sp->rows);
+         } else {
+            /* each row below is a task of its own */
+            next = xrealloc(next, (next_count + b + 1)*sizeof(task));
+            for (j = 0; j < b; j++) {
+               next[next_count] = tasks[i];
+               next[next_count].rows[next[next_count].len++] = branch[j];
+               next_count++;
+            }
+         }
+
+         for (j = 0; j < tasks[i].len; j++)
+            matrix_unselect_row(m);
+
+         if (sp->found)
+            break;
+      }
+
+      free(tasks);
+      tasks = next;
+      count = next_count;
+
+      if (sp->found || !count)
+         break;
+   }
+
+   free(branch);
+   *out = tasks;
+   return sp->found ? -1 : count;
+}
+
+/* solves the exact cover problem represented by the DLX matrix on jobs
+ * threads, each searching its own copy of the matrix, and stores the rows
+ * of the solution into the given list as matrix_solve does. The top
+ * branches of the search tree are dealt out to the workers as tasks, idle
+ * workers steal tasks from busy ones, and the first solution found stops
+ * the rest. The limits, which may be NULL, apply to all the workers
+ * together: the node limit is never exceeded, and the clock is looked at
+ * every SLICE levels at most. Returns the number of rows in the solution,
+ * -1 if there isn't one, or MATRIX_GAVE_UP. */
+int matrix_solve_parallel(matrix *m, int jobs, unsigned *rows,
+      const search_limits *limits) {
+   split sp;
+   task *tasks;
+   int i, count, started = 0;
+
+   sp.m = m;
+   sp.jobs = jobs < 1 ? 1 : jobs;
+   sp.found = 0;
+   sp.gave_up = 0;
+   sp.nodes = limits ? limits->nodes : 0;
+   sp.used = 0;
+   sp.deadline = limits && limits->seconds ?
+         search_clock() + limits->seconds : 0;
+   sp.len = -1;
+   sp.rows = rows;
+   memset(&sp.stats, 0, sizeof(search_stats));
+
+   count = make_tasks(&sp, &tasks);
+   if (count <= 0) {
+      free(tasks);
+      return sp.len;
+   }
+
+   /* deal the tasks out round-robin */
+   sp.queues = xmalloc(sp.jobs*sizeof(deque));
+   for (i = 0; i < sp.jobs; i++) {
+      pthread_mutex_init(&sp.queues[i].lock, NULL);
+      sp.queues[i].tasks = xmalloc(count*sizeof(task));
+      sp.queues[i].front = sp.queues[i].back = 0;
+   }
+   for (i = 0; i < count; i++) {
+      deque *q = &sp.queues[i % sp.jobs];
+      q->tasks[q->back++] = tasks[i];
+   }
+   free(tasks);
+   pthread_mutex_init(&sp.lock, NULL);
+
+   /* start the workers; whatever we can't start a thread for, we run
+    * ourselves, which still gets through every task thanks to stealing */
+   pthread_t *threads = xmalloc(sp.jobs*sizeof(pthread_t));
+   worker *workers = xmalloc(sp.jobs*sizeof(worker));
+   for (i = 0; i < sp.jobs; i++) {
+      workers[i].sp = &sp;
+      workers[i].id = i;
+   }
+   for (i = 1; i < sp.jobs; i++)
+      if (!pthread_create(&threads[started], NULL, split_worker, &workers[i]))
+         started++;
+   split_worker(&workers[0]);
+   for (i = 0; i < started; i++)
+      pthread_join(threads[i], NULL);
+   if (matrix_stats(m))
+      stats_add(matrix_stats(m), &sp.stats);
+
+   for (i = 0; i < sp.jobs; i++) {
+      pthread_mutex_destroy(&sp.queues[i].lock);
+      free(sp.queues[i].tasks);
+   }
+   pthread_mutex_destroy(&sp.lock);
+   free(sp.queues);
+   free(threads);
+   free(workers);
+
+   return sp.found || !sp.gave_up ? sp.len : MATRIX_GAVE_UP;
+}
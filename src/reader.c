@@ -26,85 +26,369 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdlib.h>
-#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
 #include "xmalloc.h"
+#include "gunzip.h"
+#include "packed.h"
 #include "reader.h"
 
-/* reads a single line from a file */
-char *next_line(FILE *file, int *l) {
-   /* return NULL if we're at the end */
-   if (feof(file))
+/* Regular files are mapped into memory and their lines are handed out in
+ * place. Anything else, such as a pipe, is read in large blocks into a
+ * buffer of a fixed size, and lines are handed out as soon as they have
+ * arrived. A line too long to fit in the buffer can't be a puzzle, so it is
+ * cut short and the rest of it thrown away, which keeps the memory used by
+ * an endless stream bounded. Either way there is no allocation per line.
+ *
+ * A puzzle is a line of n*n cells, from top-left to bottom-right, where n is
+ * k*k. Cells are one character each, 1-9 followed by A-Z (or a-z) for 10 to
+ * 35, or for larger boards two decimal digits each, 01 to n. Anything else is
+ * an empty cell.
+ *
+ * A file that starts with a packed header (see packed.c) holds fixed-size
+ * records instead of lines, which are handed out in place the same way.
+ * Either can be gzip-compressed, in which case it's read in blocks from a
+ * thread that decompresses it (see gunzip.c). */
+
+/* a source of lines */
+struct reader {
+   int fd;
+   int own;      /* whether closing the reader closes fd */
+   char *map;    /* the mapped file, or NULL if we're reading blocks */
+   size_t map_len;
+   char *buf;    /* block buffer */
+   size_t cap;   /* size of the buffer */
+   size_t pos;   /* start of the next line in the map or buffer */
+   size_t end;   /* end of the data in the map or buffer */
+   int eof;      /* set once read() has nothing more to give */
+   int skip;     /* set while throwing away the rest of a long line */
+   size_t record; /* size of each packed record, or 0 for lines */
+   uint64_t left; /* packed records still to come */
+   gunzip *gz;    /* decompressing thread, or NULL if not compressed */
+   char *gz_map;  /* the mapped file it decompresses, if any */
+   int error;     /* set if the input couldn't be read to the end */
+};
+
+/* sets up a reader that reads an open file descriptor in blocks into a
+ * buffer of cap bytes; lines longer than that are cut short */
+reader *buffered_reader(int fd, size_t cap) {
+   reader *r = xmalloc(sizeof(reader));
+
+   r->fd = fd;
+   r->own = 0;
+   r->map = NULL;
+   r->buf = cap ? xmalloc(cap) : NULL;
+   r->cap = cap;
+   r->pos = r->end = 0;
+   r->eof = 0;
+   r->skip = 0;
+   r->record = 0;
+   r->left = 0;
+   r->gz = NULL;
+   r->gz_map = NULL;
+   r->error = 0;
+   return r;
+}
+
+/* sets up a reader for an open file descriptor, mapping it if we can */
+reader *fd_reader(int fd) {
+   struct stat st;
+
+   if (!fstat(fd, &st) && S_ISREG(st.st_mode) && st.st_size > 0) {
+      void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (map != MAP_FAILED) {
+         reader *r = buffered_reader(fd, 0);
+
+         /* we only ever walk forward through the file */
+         posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+         r->map = map;
+         r->map_len = r->end = st.st_size;
+         return r;
+      }
+   }
+
+   return buffered_reader(fd, BLOCK_SIZE);
+}
+
+/* opens a file for reading lines from; returns NULL if it can't be opened */
+reader *open_reader(const char *name) {
+   const int fd = open(name, O_RDONLY);
+   if (fd < 0)
       return NULL;
 
-   /* allocate our temporary buffer for the line */
-   char *line = xmalloc(BUF_SIZE*sizeof(char));
-   size_t lenmax = BUF_SIZE, len = 0;
-   int c;
+   reader *r = fd_reader(fd);
+   r->own = 1;
+   return r;
+}
 
-   /* fill the buffer with characters */
-   for (;;) {
-      c = fgetc(file);
+/* frees a reader, closing its file if it opened it; returns nonzero if
+ * closing failed */
+int close_reader(reader *r) {
+   int err = r->error;
+
+   if (r->gz && free_gunzip(r->gz))
+      err = 1;
+   if (r->map || r->gz_map)
+      munmap(r->map ? r->map : r->gz_map, r->map_len);
+   if (r->own && close(r->fd))
+      err = 1;
+   free(r->buf);
+   free(r);
+   return err;
+}
+
+/* reads more data into the block buffer, keeping the partial line at the
+ * end; returns 0 if there's nothing more to read */
+int fill(reader *r) {
+   ssize_t got;
+
+   /* move the partial line to the front */
+   r->end -= r->pos;
+   memmove(r->buf, r->buf + r->pos, r->end);
+   r->pos = 0;
+
+   if (r->gz) {
+      got = gunzip_read(r->gz, r->buf + r->end, r->cap - r->end);
+   } else {
+      do {
+         got = read(r->fd, r->buf + r->end, r->cap - r->end);
+      } while (got < 0 && errno == EINTR);
+   }
+
+   if (got <= 0) {
+      r->eof = 1;
+      return 0;
+   }
+
+   r->end += got;
+   return 1;
+}
+
+/* returns the next line, without its newline, storing its length; the line
+ * is only valid until the next call. Returns NULL at the end of the input.
+ * A last line that isn't terminated by a newline is ignored. */
+const char *reader_line(reader *r, size_t *len) {
+   char *data = r->map ? r->map : r->buf;
+   char *nl;
 
-      /* if we hit EOF or a newline, we're done */
-      if (c == EOF || c == '\n')
+   for (;;) {
+      nl = memchr(data + r->pos, '\n', r->end - r->pos);
+      if (nl && r->skip) {
+         /* the end of a line we already handed out the start of */
+         r->pos = nl + 1 - data;
+         r->skip = 0;
+         continue;
+      }
+      if (nl)
          break;
+      if (r->skip) {
+         /* still in the middle of the line, throw away what we have */
+         r->pos = r->end;
+      } else if (!r->map && r->pos == 0 && r->end == r->cap) {
+         /* the line fills the buffer, so hand out what we have of it */
+         r->pos = r->end;
+         r->skip = 1;
+         *len = r->cap;
+         return data;
+      }
+      if (r->map || r->eof || !fill(r))
+         return NULL;
+      data = r->buf;
+   }
 
-      /* put the character into the buffer */
-      line[len++] = c;
+   const char *line = data + r->pos;
+   *len = nl - line;
+   r->pos += *len + 1;
+   return line;
+}
 
-      /* if we're out of room, double the size of our buffer */
-      if (len == lenmax)
-         line = xrealloc(line, (lenmax *= 2));
+/* returns the next line without moving past it, like reader_line */
+const char *reader_peek(reader *r, size_t *len) {
+   const char *line = reader_line(r, len);
+   if (line && r->skip) {
+      /* a line that was cut short starts the buffer, and will be cut short
+       * the same way again */
+      r->pos = 0;
+      r->skip = 0;
+   } else if (line) {
+      r->pos -= *len + 1;
    }
+   return line;
+}
+
+/* returns the next len bytes, which are only valid until the next call, or
+ * NULL if the input ends before them; the last block of a file that's cut
+ * short is ignored */
+const char *reader_block(reader *r, size_t len) {
+   const char *block;
+
+   while (r->end - r->pos < len)
+      if (r->map || r->eof || !fill(r))
+         return NULL;
+
+   block = (r->map ? r->map : r->buf) + r->pos;
+   r->pos += len;
+   return block;
+}
+
+/* switches a reader over to decompressing what it holds on another
+ * thread, starting from what's been read of it so far. If the thread can't
+ * be started the input is cut short there, and closing it fails. */
+void start_gunzip(reader *r) {
+   if (r->map) {
+      /* the thread works straight from the mapped file */
+      r->gz = new_gunzip(-1, r->map, r->map_len);
+      r->gz_map = r->map;
+      r->map = NULL;
+      r->cap = BLOCK_SIZE;
+      r->buf = xmalloc(r->cap);
+   } else {
+      /* the thread takes what we've read and reads the rest itself */
+      r->gz = new_gunzip(r->fd, r->buf + r->pos, r->end - r->pos);
+   }
+   r->pos = r->end = 0;
+   r->eof = !r->gz;
+   r->error = !r->gz;
+}
 
-   /* store the length, add a null byte at the end, and resize the buffer to
-    * exactly fit the string */
-   *l = len;
-   line[len++] = '\0';
-   return xrealloc(line, len);
-}
-
-/* reads in the next Sudoku puzzle from a file */
-int **next_puzzle(int k, FILE *file) {
-   const int n = k*k, n2 = n*n;
-   int len;
-   char *line;
-   
-   /* try to get the next line if we can, otherwise call it quits */
-   if (!(line = next_line(file, &len)))
+/* works out what an input holds before anything is read from it, first
+ * decompressing it if it's gzip-compressed. If it starts with a packed
+ * header, moves past it, sets *kind to the kind of its records and
+ * returns their order; otherwise sets *kind to 0 and returns the order
+ * that fits the length of the first line, or 0. */
+int detect_input(reader *r, int *kind) {
+   const char *header = reader_block(r, 2);
+   const char *line;
+   packed_kind pk;
+   size_t len;
+   int k;
+
+   if (header)
+      r->pos -= 2;
+   if (header && is_gzip(header, 2))
+      start_gunzip(r);
+   header = reader_block(r, PACKED_HEADER);
+
+   if (header && packed_read_header(header, &k, &pk, &r->left)) {
+      r->record = packed_record_size(k, pk);
+      *kind = pk;
+      return k;
+   }
+   if (header)
+      r->pos -= PACKED_HEADER;
+
+   *kind = 0;
+   return (line = reader_peek(r, &len)) ? detect_order(len) : 0;
+}
+
+/* returns the next record of a packed input, which is only valid until the
+ * next call, or NULL once they run out */
+const char *reader_record(reader *r) {
+   const char *record;
+
+   if (!r->left || !(record = reader_block(r, r->record)))
       return NULL;
+   if (r->left != PACKED_UNKNOWN)
+      r->left--;
+   return record;
+}
 
-   int x, y, c;
-   int **puzzle = NULL;
+/* reads the next puzzle of order k into grid, from a line or a packed
+ * record; returns 1 if it was read, 0 if it was the wrong length or
+ * out of range, and -1 at the end of the input */
+int reader_puzzle(reader *r, int k, uint8_t *grid) {
+   const char *data;
+   size_t len;
+
+   if (r->record) {
+      if (!(data = reader_record(r)))
+         return -1;
+      return unpack_cells(k, data, grid);
+   }
+   if (!(data = reader_line(r, &len)))
+      return -1;
+   return parse_puzzle(k, data, len, grid);
+}
+
+/* works out the order of the boards in a file from the length of a line,
+ * in either cell encoding; returns 0 if no order fits */
+int detect_order(size_t len) {
+   size_t k;
+   for (k = 2; k <= MAX_K; k++)
+      if (len == k*k*k*k || len == 2*k*k*k*k)
+         return k;
+   return 0;
+}
+
+/* the value of a one-character cell, or 0 if it's empty */
+int cell_value(char c) {
+   if ('1' <= c && c <= '9')
+      return c - '0';
+   if ('A' <= c && c <= 'Z')
+      return c - 'A' + 10;
+   if ('a' <= c && c <= 'z')
+      return c - 'a' + 10;
+   return 0;
+}
+
+/* the value of a two-digit cell, or 0 if it's empty */
+int wide_cell_value(const char *c) {
+   if ('0' <= c[0] && c[0] <= '9' && '0' <= c[1] && c[1] <= '9')
+      return 10*(c[0] - '0') + c[1] - '0';
+   return 0;
+}
+
+/* converts a line into the n*n cells of a Sudoku puzzle grid, in the same
+ * row-major order as the line, with 0 for empty cells; returns 0 if the line
+ * is the wrong length for boards of order k in either encoding */
+int parse_puzzle(int k, const char *line, size_t len, uint8_t *grid) {
+   const int n = k*k;
+   int i, wide;
 
    /* make sure the line is the correct length */
-   if (len == n2) {
-      /* allocate our grid */
-      puzzle = xmalloc(n * sizeof(int*));
-      for (x = 0; x < n; x++)
-         puzzle[x] = xmalloc(n * sizeof(int));
-
-      /* fill the grid with values */
-      for (y = 0; y < n; y++) {
-         for (x = 0; x < n; x++) {
-            /* only add values in the right range, otherwise add zeroes */
-            const int v = line[x+n*y] - '0';
-            puzzle[x][y] = (v > 0 && v <= n) ? v : 0;
-         }
-      }
+   if (len == (size_t)(n*n))
+      wide = 0;
+   else if (len == (size_t)(2*n*n))
+      wide = 1;
+   else
+      return 0;
+
+   /* fill the grid with values */
+   for (i = 0; i < n*n; i++) {
+      /* only add values in the right range, otherwise add zeroes */
+      const int v = wide ? wide_cell_value(line + 2*i) : cell_value(line[i]);
+      grid[i] = (v > 0 && v <= n) ? v : 0;
    }
 
-   /* clean up and return */
-   free(line);
-   return puzzle;
+   return 1;
 }
 
-/* frees a puzzle grid */
-void free_puzzle(const int k, int **puzzle) {
+/* writes the n*n cells of a puzzle grid as a line that parse_puzzle reads
+ * back, with 0 (or 00) for empty cells and a newline at the end; line must
+ * hold 2*n*n + 1 characters. Returns the length of the line. */
+unsigned format_puzzle(int k, const uint8_t *grid, char *line) {
+   const char *digits = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
    const int n = k*k;
+   char *p = line;
    int i;
-   for (i = 0; i < n; i++)
-      free(puzzle[i]);
-   free(puzzle);
+
+   for (i = 0; i < n*n; i++) {
+      if (n > 35) {
+         *p++ = '0' + grid[i]/10;
+         *p++ = '0' + grid[i]%10;
+      } else {
+         *p++ = digits[grid[i]];
+      }
+   }
+   *p++ = '\n';
+   return p - line;
 }
@@ -26,12 +26,36 @@
  * POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #ifndef READER_H_GUARD
 #define READER_H_GUARD
 
-#define BUF_SIZE 81
+#include <stddef.h>
+#include <stdint.h>
+
+/* largest board order we can read */
+#define MAX_K 8
+
+/* number of cells on the largest board */
+#define MAX_CELLS (MAX_K*MAX_K*MAX_K*MAX_K)
+
+/* size of the blocks read from inputs that can't be mapped */
+#define BLOCK_SIZE (1 << 20)
+
+typedef struct reader reader;
 
-int **next_puzzle(int k, FILE *file);
-void free_puzzle(int k, int **puzzle);
+reader *open_reader(const char *name);
+reader *fd_reader(int fd);
+reader *buffered_reader(int fd, size_t cap);
+int close_reader(reader *r);
+const char *reader_line(reader *r, size_t *len);
+const char *reader_peek(reader *r, size_t *len);
+const char *reader_block(reader *r, size_t len);
+int detect_input(reader *r, int *kind);
+const char *reader_record(reader *r);
+int reader_puzzle(reader *r, int k, uint8_t *grid);
+int detect_order(size_t len);
+int parse_puzzle(int k, const char *line, size_t len, uint8_t *grid);
+unsigned format_puzzle(int k, const uint8_t *grid, char *line);
 
 #endif
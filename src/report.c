@@ -0,0 +1,349 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+#include "reader.h"
+#include "bitboard.h"
+#include "packed.h"
+#include "report.h"
+
+/* the longest line report_stats can produce */
+#define STATS_SIZE (160 + 8*STATS_DEPTH)
+
+/* the largest report any puzzle of order k can produce */
+unsigned report_size(int k) {
+   const unsigned n = k*k;
+   return 96 + n*(2*n+7) + STATS_SIZE;
+}
+
+/* writes a line of search effort counters into buf, after the prefix, with
+ * the average number of rows in the columns picked at each level; buf must
+ * hold STATS_SIZE bytes more than the prefix. Returns the number of
+ * characters written. */
+unsigned report_stats(char *buf, const char *prefix, const search_stats *st) {
+   const unsigned depth = st->max_depth < STATS_DEPTH ? st->max_depth
+                                                      : STATS_DEPTH;
+   unsigned i;
+   char *p = buf;
+
+   p += sprintf(p, "%s%lu nodes, %lu rows, %lu backtracks, %lu covers, "
+         "depth %u, branching", prefix, st->nodes, st->rows, st->backtracks,
+         st->covers, st->max_depth);
+   for (i = 0; i < depth; i++)
+      p += sprintf(p, " %.2f", st->picks[i] ?
+            (double)st->branches[i] / st->picks[i] : 0.0);
+   *p++ = '\n';
+
+   return p - buf;
+}
+
+/* adds a puzzle's counters to the total for its file; the compact formats
+ * keep their output clean, so their per-puzzle counters go to stderr */
+void report_tally(search_stats *total, const search_stats *st,
+      unsigned num, options *opt) {
+   char line[32 + STATS_SIZE], prefix[32];
+
+   stats_add(total, st);
+   if (opt->style != FORMAT_FULL) {
+      sprintf(prefix, "%u: ", num);
+      fwrite(line, 1, report_stats(line, prefix, st), stderr);
+   }
+}
+
+/* reports the total counters for a file, after its puzzles */
+void report_total(writer *out, const search_stats *total, options *opt) {
+   char line[32 + STATS_SIZE];
+
+   if (opt->style == FORMAT_FULL)
+      writer_write(out, line, report_stats(line, "   Total effort: ", total));
+   else
+      fwrite(line, 1, report_stats(line, "total: ", total), stderr);
+}
+
+/* reports how the cache did on a file, from its counters before and after
+ * the file's puzzles */
+void report_cache(writer *out, const cache_stats *before,
+      const cache_stats *after, options *opt) {
+   const unsigned long lookups = after->lookups - before->lookups;
+   const unsigned long hits = after->hits - before->hits;
+   char line[256];
+   int len;
+
+   len = sprintf(line, "%s%lu lookups, %lu hits (%.1f%%, %lu exact), "
+         "%lu skipped, %lu of %lu entries used, %lu evictions\n",
+         opt->style == FORMAT_FULL ? "   Cache: " : "cache: ",
+         lookups, hits, lookups ? 100.0*hits / lookups : 0.0,
+         after->exact_hits - before->exact_hits,
+         after->skipped - before->skipped, after->entries, after->capacity,
+         after->evictions - before->evictions);
+   if (opt->style == FORMAT_FULL)
+      writer_write(out, line, len);
+   else
+      fwrite(line, 1, len, stderr);
+}
+
+/* writes a 0-based value the way the full report shows it: one base-36
+ * digit, which is hex up to 16x16, or two decimal digits for boards bigger
+ * than 36x36. Returns the number of characters written. */
+unsigned put_full_cell(char *p, int v, int n) {
+   const char *digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+   if (n > 36) {
+      p[0] = '0' + v/10;
+      p[1] = '0' + v%10;
+      return 2;
+   }
+   *p = digits[v];
+   return 1;
+}
+
+/* writes a 0-based value in the input encoding: 1-9 then A-Z, or two
+ * decimal digits for boards bigger than 35x35 */
+unsigned put_input_cell(char *p, int v, int n) {
+   const char *digits = "123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+   if (n > 35) {
+      p[0] = '0' + (v+1)/10;
+      p[1] = '0' + (v+1)%10;
+      return 2;
+   }
+   *p = digits[v];
+   return 1;
+}
+
+/* copies a string into buf, returning its length */
+unsigned put_str(char *buf, const char *s) {
+   const unsigned len = strlen(s);
+   memcpy(buf, s, len);
+   return len;
+}
+
+/* writes a number into buf in decimal, returning its length */
+unsigned put_num(char *buf, unsigned long v) {
+   char tmp[24];
+   unsigned len = 0, i;
+
+   do {
+      tmp[len++] = '0' + v%10;
+      v /= 10;
+   } while (v);
+
+   for (i = 0; i < len; i++)
+      buf[i] = tmp[len-1-i];
+   return len;
+}
+
+/* describes how many solutions a puzzle has, as found by solver_enumerate */
+unsigned report_count(char *buf, unsigned long count, unsigned long limit) {
+   char *p = buf;
+
+   if (!count)
+      return put_str(p, "No solution.");
+   if (count != limit && count == 1)
+      return put_str(p, "Unique solution.");
+
+   if (count == limit)
+      p += put_str(p, "At least ");
+   p += put_num(p, count);
+   p += put_str(p, count == 1 ? " solution." : " solutions.");
+   return p - buf;
+}
+
+/* solves puzzle number num, or counts its solutions, and writes what we
+ * found into buf in the format chosen by opt->style; buf must hold
+ * report_size bytes. A NULL puzzle is one that was the wrong length.
+ * Returns the number of characters written. The random strategy is seeded
+ * from the puzzle number, so the result doesn't depend on which solver
+ * handles the puzzle. */
+unsigned report_puzzle(char *buf, unsigned num, const uint8_t *puzzle,
+      solver *s, options *opt, search_stats *stats) {
+   char status[64];
+   unsigned status_len;
+   uint8_t soln[MAX_CELLS];
+   packed_status code = PACKED_INVALID;
+   int ok = 0, searched = 0;
+
+   if (!puzzle) {
+      /* puzzle wasn't valid... the only way this can happen is if the
+       * puzzle was the wrong length */
+      status_len = put_str(status, "Invalid length.");
+   } else if (opt->count) {
+      /* valid puzzle, count its solutions; only a unique solution counts
+       * as a success */
+      unsigned long count;
+      solver_set_strategy(s, opt->strategy, opt->seed + num);
+      count = solver_enumerate(s, puzzle, opt->limit, NULL, NULL);
+      searched = 1;
+      status_len = report_count(status, count, opt->limit);
+      ok = count == 1 && count != opt->limit;
+   } else {
+      /* valid puzzle, look it up or try to solve it */
+      solve_status st;
+      cache_key key;
+
+      if (!opt->cache ||
+            !cache_lookup(opt->cache, opt->k, puzzle, &key, soln, &st)) {
+         solver_set_strategy(s, opt->strategy, opt->seed + num);
+         solver_set_limits(s, &opt->limits);
+         if (opt->engine == BACKEND_BITBOARD && opt->k == 3) {
+            st = bitboard_solve(opt->k, puzzle, soln) ? SOLVE_FOUND
+                                                      : SOLVE_NONE;
+         } else {
+            st = opt->split ? solver_solve_split(s, puzzle, soln, opt->jobs)
+                            : solver_solve(s, puzzle, soln);
+            searched = 1;
+         }
+         if (opt->cache)
+            cache_insert(opt->cache, &key, puzzle, soln, st);
+      }
+
+      /* giving up is not the same as there being no solution */
+      ok = st == SOLVE_FOUND;
+      status_len = put_str(status, ok ? "Solved."
+                                 : st == SOLVE_GAVE_UP ? "Gave up."
+                                 : "No solution.");
+      code = ok ? PACKED_SOLVED
+                : st == SOLVE_GAVE_UP ? PACKED_GAVE_UP : PACKED_NO_SOLUTION;
+   }
+
+   /* hand back what the search took; the bitboard backend and puzzles that
+    * couldn't be read don't touch the matrix */
+   if (stats) {
+      if (searched && solver_stats(s))
+         *stats = *solver_stats(s);
+      else
+         memset(stats, 0, sizeof(search_stats));
+   }
+
+   return report_outcome(buf, num, status, status_len, ok ? soln : NULL,
+         code, opt, stats);
+}
+
+/* writes the report for puzzle number num into buf, given the status line
+ * for it and its solution, or NULL if it wasn't solved; counts don't show
+ * the solution. Returns the number of characters written. */
+unsigned report_outcome(char *buf, unsigned num, const char *status,
+      unsigned status_len, const uint8_t *soln, packed_status code,
+      options *opt, const search_stats *stats) {
+   const int n = opt->k*opt->k;
+   const int ok = soln != NULL;
+   uint8_t none[MAX_CELLS];
+   char *p = buf;
+   int x, y;
+
+   switch (opt->style) {
+   case FORMAT_FULL:
+      /* the outcome, then the solution one row per line */
+      p += put_str(p, "   Solving puzzle #");
+      p += put_num(p, num);
+      p += put_str(p, ": ");
+      memcpy(p, status, status_len);
+      p += status_len;
+      *p++ = '\n';
+
+      if (ok && !opt->count) {
+         for (y = 0; y < n; y++) {
+            p += put_str(p, "      ");
+            for (x = 0; x < n; x++)
+               p += put_full_cell(p, soln[y*n + x] - 1, n);
+            *p++ = '\n';
+         }
+      }
+      if (stats)
+         p += report_stats(p, "      Effort: ", stats);
+      break;
+
+   case FORMAT_LINE:
+   case FORMAT_SOLUTION:
+      /* the solution in the same form as the input, or else the outcome */
+      if (ok && !opt->count) {
+         for (x = 0; x < n*n; x++)
+            p += put_input_cell(p, soln[x] - 1, n);
+         *p++ = '\n';
+      } else if (opt->style == FORMAT_LINE) {
+         memcpy(p, status, status_len);
+         p += status_len;
+         *p++ = '\n';
+      }
+      break;
+
+   case FORMAT_FAILURES:
+      /* the puzzle number and what went wrong */
+      if (!ok) {
+         p += put_num(p, num);
+         p += put_str(p, ": ");
+         memcpy(p, status, status_len);
+         p += status_len;
+         *p++ = '\n';
+      }
+      break;
+
+   case FORMAT_BINARY:
+      /* a fixed-size record of the outcome and the solution; counting
+       * doesn't have one */
+      *p++ = code;
+      if (!ok) {
+         memset(none, 0, n*n);
+         soln = none;
+      }
+      pack_cells(opt->k, soln, p);
+      p += packed_cells_size(opt->k);
+      break;
+   }
+
+   return p - buf;
+}
+
+/* reports on puzzle number num after the lockstep solver has been at it,
+ * with result and soln from lockstep_solve; a puzzle singles couldn't
+ * settle is handed on to report_puzzle. A settled one took no search, so
+ * its counters are all zero. */
+unsigned report_lockstep(char *buf, unsigned num, const uint8_t *puzzle,
+      lockstep_result result, const uint8_t *soln, solver *s, options *opt,
+      search_stats *stats) {
+   const int ok = result == LOCKSTEP_SOLVED;
+   char status[16];
+   unsigned status_len;
+
+   if (result == LOCKSTEP_STUCK)
+      return report_puzzle(buf, num, puzzle, s, opt, stats);
+
+   if (stats)
+      memset(stats, 0, sizeof(search_stats));
+   status_len = put_str(status, ok ? "Solved." : "No solution.");
+   return report_outcome(buf, num, status, status_len, ok ? soln : NULL,
+         ok ? PACKED_SOLVED : PACKED_NO_SOLUTION, opt, stats);
+}
+
+/* whether puzzles should go through the lockstep solver, which only takes
+ * 9x9 boards and only finds solutions */
+int lockstep_usable(const options *opt) {
+   return opt->engine == BACKEND_LOCKSTEP && opt->k == 3 && !opt->count;
+}
@@ -0,0 +1,57 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef REPORT_H_GUARD
+#define REPORT_H_GUARD
+
+#include "options.h"
+#include "solver.h"
+#include "output.h"
+#include "cache.h"
+#include "packed.h"
+#include "lockstep.h"
+
+unsigned report_size(int k);
+unsigned report_stats(char *buf, const char *prefix, const search_stats *st);
+void report_tally(search_stats *total, const search_stats *st,
+      unsigned num, options *opt);
+void report_total(writer *out, const search_stats *total, options *opt);
+void report_cache(writer *out, const cache_stats *before,
+      const cache_stats *after, options *opt);
+unsigned report_puzzle(char *buf, unsigned num, const uint8_t *puzzle,
+      solver *s, options *opt, search_stats *stats);
+unsigned report_outcome(char *buf, unsigned num, const char *status,
+      unsigned status_len, const uint8_t *soln, packed_status code,
+      options *opt, const search_stats *stats);
+int lockstep_usable(const options *opt);
+unsigned report_lockstep(char *buf, unsigned num, const uint8_t *puzzle,
+      lockstep_result result, const uint8_t *soln, solver *s, options *opt,
+      search_stats *stats);
+
+#endif
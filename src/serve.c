@@ -0,0 +1,514 @@
+/* Copyright (c) 2012, Brendan Conniff
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ * 3. Neither the name of Brendan Conniff nor the names of its contributors may
+ *    be used to endorse or promote products derived from this software without
+ *    specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "xmalloc.h"
+#include "reader.h"
+#include "solver.h"
+#include "report.h"
+#include "serve.h"
+
+/* The server listens on a Unix domain socket and speaks a line protocol:
+ * each line a client sends is a puzzle, and it gets back one line holding
+ * the solution or the outcome, exactly as -o line prints them. Clients can
+ * send as many puzzles as they like without waiting, and the answers come
+ * back in the order the puzzles were sent.
+ *
+ * Each client has a thread reading its puzzles and a thread writing its
+ * answers. Puzzles go through one bounded queue to a pool of workers, each
+ * with its own solvers that stay built between requests. When the queue is
+ * full, or a client has too many answers it hasn't read yet, its reading
+ * thread waits, so the client is pushed back on through its socket.
+ *
+ * SIGINT or SIGTERM shut the server down gracefully: it stops accepting
+ * clients and reading puzzles, answers every puzzle it has already read,
+ * and removes the socket. Clients that don't read their answers within a
+ * grace period are cut off, so that one of them can't hold the server up
+ * forever. */
+
+/* number of puzzles waiting for a worker, across all clients */
+#define QUEUE_SIZE 1024
+
+/* number of puzzles a client can have sent without reading the answers */
+#define MAX_INFLIGHT 256
+
+/* size of each client's input buffer: room for the longest puzzle line,
+ * two digits a cell, and a CR LF after it */
+#define LINE_BUFFER (2*MAX_CELLS + 2)
+
+/* seconds clients get to read their last answers on shutdown */
+#define SHUTDOWN_GRACE 5
+
+/* milliseconds to wait before accepting again when we're out of files */
+#define ACCEPT_BACKOFF 100
+
+/* default order for lines that don't give one away by their length */
+#define DEFAULT_K 3
+
+typedef struct server server;
+typedef struct client client;
+
+/* a puzzle from a client, and the answer to it once a worker is done */
+typedef struct request {
+   client *c;
+   unsigned num;    /* number of the puzzle on its connection */
+   int k;
+   int valid;       /* whether the line was the right length */
+   int done;
+   uint8_t cells[MAX_CELLS];
+   char *out;       /* the answer, report_size(MAX_K) bytes */
+   unsigned len;
+   struct request *next;
+} request;
+
+/* a connected client */
+struct client {
+   server *srv;
+   int fd;
+   pthread_mutex_t lock;
+   pthread_cond_t ready;  /* signalled when an answer is done */
+   pthread_cond_t room;   /* signalled when an answer has been written */
+   request *head, *tail;  /* puzzles read but not yet answered, in order */
+   unsigned inflight;
+   int eof;               /* set once the reading thread is finished */
+   struct client *next;
+};
+
+/* state shared by the whole server */
+struct server {
+   options *opt;
+   int fd;                /* the listening socket */
+   pthread_mutex_t lock;
+   pthread_cond_t work;   /* signalled when the queue has a request */
+   pthread_cond_t room;   /* signalled when the queue has room */
+   pthread_cond_t gone;   /* signalled when a client goes away */
+   request *queue[QUEUE_SIZE];
+   unsigned front, count;
+   client *clients;
+   int quit;              /* set once the workers should stop */
+   int closing;           /* set once a signal asks us to shut down */
+};
+
+/* worker thread: answers requests from the queue with solvers that are
+ * kept for as long as the server runs */
+void *serve_worker(void *arg) {
+   server *srv = arg;
+   solver *solvers[MAX_K+1] = { NULL };
+   options opt = *srv->opt;
+   int i;
+
+   /* every answer is a single line */
+   opt.style = FORMAT_LINE;
+   opt.stats = 0;
+   opt.split = 0;
+
+   pthread_mutex_lock(&srv->lock);
+   for (;;) {
+      while (!srv->quit && !srv->count)
+         pthread_cond_wait(&srv->work, &srv->lock);
+      if (!srv->count)
+         break;
+
+      request *r = srv->queue[srv->front];
+      srv->front = (srv->front + 1) % QUEUE_SIZE;
+      srv->count--;
+      pthread_cond_signal(&srv->room);
+      pthread_mutex_unlock(&srv->lock);
+
+      /* answer it without holding the lock */
+      if (!solvers[r->k])
+         solvers[r->k] = xcheck(new_solver(r->k));
+      opt.k = r->k;
+      r->len = report_puzzle(r->out, r->num, r->valid ? r->cells : NULL,
+            solvers[r->k], &opt, NULL);
+
+      pthread_mutex_lock(&r->c->lock);
+      r->done = 1;
+      pthread_cond_signal(&r->c->ready);
+      pthread_mutex_unlock(&r->c->lock);
+
+      pthread_mutex_lock(&srv->lock);
+   }
+   pthread_mutex_unlock(&srv->lock);
+
+   for (i = 0; i <= MAX_K; i++)
+      if (solvers[i])
+         free_solver(solvers[i]);
+   return NULL;
+}
+
+/* reading thread: turns a client's lines into requests, waiting whenever
+ * the client or the queue has too many outstanding */
+void *client_reader(void *arg) {
+   client *c = arg;
+   server *srv = c->srv;
+   reader *in = buffered_reader(c->fd, LINE_BUFFER);
+   const char *line;
+   unsigned num = 0;
+   size_t len;
+
+   while ((line = reader_line(in, &len))) {
+      request *r = xmalloc(sizeof(request) + report_size(MAX_K));
+      r->c = c;
+      r->num = ++num;
+      r->out = (char *)(r + 1);
+      r->done = 0;
+      r->next = NULL;
+      r->k = srv->opt->k ? srv->opt->k : detect_order(len);
+      if (!r->k)
+         r->k = DEFAULT_K;
+      r->valid = parse_puzzle(r->k, line, len, r->cells);
+
+      /* wait for the client to read some answers if it's too far behind,
+       * then queue the request behind the client's others */
+      pthread_mutex_lock(&c->lock);
+      while (c->inflight >= MAX_INFLIGHT)
+         pthread_cond_wait(&c->room, &c->lock);
+      c->inflight++;
+      if (c->tail)
+         c->tail->next = r;
+      else
+         c->head = r;
+      c->tail = r;
+      pthread_mutex_unlock(&c->lock);
+
+      /* and wait for room in the queue for the workers */
+      pthread_mutex_lock(&srv->lock);
+      while (srv->count == QUEUE_SIZE)
+         pthread_cond_wait(&srv->room, &srv->lock);
+      srv->queue[(srv->front + srv->count++) % QUEUE_SIZE] = r;
+      pthread_cond_signal(&srv->work);
+      pthread_mutex_unlock(&srv->lock);
+   }
+   close_reader(in);
+
+   /* let the writing thread know there's nothing more coming; c can't be
+    * touched after this */
+   pthread_mutex_lock(&c->lock);
+   c->eof = 1;
+   pthread_cond_signal(&c->ready);
+   pthread_mutex_unlock(&c->lock);
+
+   return NULL;
+}
+
+/* writes all of a block to a socket; returns -1 if the client has gone */
+int write_all(int fd, const char *data, size_t len) {
+   while (len) {
+      const ssize_t got = write(fd, data, len);
+      if (got < 0) {
+         if (errno == EINTR)
+            continue;
+         return -1;
+      }
+      data += got;
+      len -= got;
+   }
+   return 0;
+}
+
+/* writing thread: sends a client's answers back in order as they're done,
+ * then cleans up the client once it has nothing left to send */
+void *client_writer(void *arg) {
+   client *c = arg;
+   server *srv = c->srv;
+   int broken = 0;
+
+   pthread_mutex_lock(&c->lock);
+   for (;;) {
+      while (!(c->head && c->head->done) && !(c->eof && !c->head))
+         pthread_cond_wait(&c->ready, &c->lock);
+      if (!c->head)
+         break;
+
+      request *r = c->head;
+      c->head = r->next;
+      if (!c->head)
+         c->tail = NULL;
+      pthread_mutex_unlock(&c->lock);
+
+      /* a client that went away still has its requests finished, so that
+       * the workers never touch a freed client */
+      if (!broken && write_all(c->fd, r->out, r->len))
+         broken = 1;
+      free(r);
+
+      pthread_mutex_lock(&c->lock);
+      c->inflight--;
+      pthread_cond_signal(&c->room);
+   }
+   pthread_mutex_unlock(&c->lock);
+
+   /* take the client off the server's list */
+   pthread_mutex_lock(&srv->lock);
+   client **p = &srv->clients;
+   while (*p != c)
+      p = &(*p)->next;
+   *p = c->next;
+   pthread_cond_signal(&srv->gone);
+   pthread_mutex_unlock(&srv->lock);
+
+   close(c->fd);
+   pthread_mutex_destroy(&c->lock);
+   pthread_cond_destroy(&c->ready);
+   pthread_cond_destroy(&c->room);
+   free(c);
+   return NULL;
+}
+
+/* signal thread: waits for SIGINT or SIGTERM, and wakes the accepting
+ * thread up to shut down */
+void *serve_signals(void *arg) {
+   server *srv = arg;
+   sigset_t set;
+   int sig;
+
+   sigemptyset(&set);
+   sigaddset(&set, SIGINT);
+   sigaddset(&set, SIGTERM);
+   sigwait(&set, &sig);
+
+   pthread_mutex_lock(&srv->lock);
+   srv->closing = 1;
+   pthread_mutex_unlock(&srv->lock);
+   shutdown(srv->fd, SHUT_RDWR);
+   return NULL;
+}
+
+/* starts the threads for a newly accepted client; returns 0 if they
+ * couldn't be started */
+int add_client(server *srv, int fd) {
+   client *c = xmalloc(sizeof(client));
+   pthread_t reading, writing;
+
+   c->srv = srv;
+   c->fd = fd;
+   c->head = c->tail = NULL;
+   c->inflight = 0;
+   c->eof = 0;
+   pthread_mutex_init(&c->lock, NULL);
+   pthread_cond_init(&c->ready, NULL);
+   pthread_cond_init(&c->room, NULL);
+
+   pthread_mutex_lock(&srv->lock);
+   c->next = srv->clients;
+   srv->clients = c;
+   pthread_mutex_unlock(&srv->lock);
+
+   /* the writing thread frees the client once the reading thread is done,
+    * so the reading thread has to start first */
+   if (pthread_create(&reading, NULL, client_reader, c)) {
+      c->eof = 1;
+      client_writer(c);
+      return 0;
+   }
+   pthread_detach(reading);
+   if (pthread_create(&writing, NULL, client_writer, c)) {
+      /* answer the client from this thread instead */
+      client_writer(c);
+      return 1;
+   }
+   pthread_detach(writing);
+   return 1;
+}
+
+/* checks whether a server is still listening on a socket, so it isn't
+ * taken away from it; only a refused or missing socket counts as stale */
+int socket_live(const struct sockaddr_un *addr) {
+   const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+   int live;
+
+   if (fd < 0)
+      return 1;
+   live = !connect(fd, (const struct sockaddr *)addr, sizeof(*addr)) ||
+         (errno != ECONNREFUSED && errno != ENOENT);
+   close(fd);
+   return live;
+}
+
+/* opens a listening socket at path, replacing a stale socket left there;
+ * returns -1 if it can't */
+int listen_at(const char *path) {
+   struct sockaddr_un addr;
+   struct stat st;
+   int fd;
+
+   if (strlen(path) >= sizeof(addr.sun_path)) {
+      fprintf(stderr, "Socket path too long: %s\n", path);
+      return -1;
+   }
+
+   memset(&addr, 0, sizeof(addr));
+   addr.sun_family = AF_UNIX;
+   strcpy(addr.sun_path, path);
+
+   /* only ever remove something that is a socket, and only if nothing is
+    * listening on it any more */
+   if (!stat(path, &st) && S_ISSOCK(st.st_mode)) {
+      if (socket_live(&addr)) {
+         fprintf(stderr, "Couldn't listen on socket: %s: %s\n", path,
+               strerror(EADDRINUSE));
+         return -1;
+      }
+      unlink(path);
+   }
+
+   if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+         bind(fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+         listen(fd, SOMAXCONN)) {
+      fprintf(stderr, "Couldn't listen on socket: %s: %s\n", path,
+            strerror(errno));
+      if (fd >= 0)
+         close(fd);
+      return -1;
+   }
+
+   return fd;
+}
+
+/* serves puzzles on a Unix domain socket at path until SIGINT or SIGTERM,
+ * with opt->jobs workers; returns the exit status for the program */
+int serve(const char *path, options *opt) {
+   const int jobs = opt->jobs > 1 ? opt->jobs : 1;
+   pthread_t *workers = xmalloc(jobs * sizeof(pthread_t));
+   pthread_t signals;
+   server srv;
+   sigset_t set;
+   int j, started = 0, fd;
+
+   if ((srv.fd = listen_at(path)) < 0) {
+      free(workers);
+      return 1;
+   }
+
+   srv.opt = opt;
+   srv.front = srv.count = 0;
+   srv.clients = NULL;
+   srv.quit = srv.closing = 0;
+   pthread_mutex_init(&srv.lock, NULL);
+   pthread_cond_init(&srv.work, NULL);
+   pthread_cond_init(&srv.room, NULL);
+   pthread_cond_init(&srv.gone, NULL);
+
+   /* the signals are only taken by the signal thread, and a client going
+    * away mid-answer shouldn't kill us */
+   sigemptyset(&set);
+   sigaddset(&set, SIGINT);
+   sigaddset(&set, SIGTERM);
+   pthread_sigmask(SIG_BLOCK, &set, NULL);
+   signal(SIGPIPE, SIG_IGN);
+
+   for (j = 0; j < jobs; j++)
+      if (!pthread_create(&workers[started], NULL, serve_worker, &srv))
+         started++;
+   if (!started || pthread_create(&signals, NULL, serve_signals, &srv)) {
+      fprintf(stderr, "Couldn't start the server threads\n");
+      srv.closing = 1;
+   } else {
+      pthread_detach(signals);
+   }
+
+   /* accept clients until we're told to stop */
+   for (;;) {
+      fd = accept(srv.fd, NULL, NULL);
+
+      pthread_mutex_lock(&srv.lock);
+      const int closing = srv.closing;
+      pthread_mutex_unlock(&srv.lock);
+      if (closing) {
+         if (fd >= 0)
+            close(fd);
+         break;
+      }
+
+      if (fd < 0) {
+         if (errno == EINTR || errno == ECONNABORTED)
+            continue;
+         if (errno == EMFILE || errno == ENFILE) {
+            /* the pending connection stays queued, so give clients a
+             * chance to close some files rather than spinning on it */
+            struct timespec pause;
+            pause.tv_sec = 0;
+            pause.tv_nsec = ACCEPT_BACKOFF * 1000000L;
+            nanosleep(&pause, NULL);
+            continue;
+         }
+         perror("accept");
+         break;
+      }
+      add_client(&srv, fd);
+   }
+
+   /* stop reading from the clients, and wait for them to be answered */
+   pthread_mutex_lock(&srv.lock);
+   client *c;
+   for (c = srv.clients; c; c = c->next)
+      shutdown(c->fd, SHUT_RD);
+   struct timespec deadline;
+   clock_gettime(CLOCK_REALTIME, &deadline);
+   deadline.tv_sec += SHUTDOWN_GRACE;
+   while (srv.clients &&
+         pthread_cond_timedwait(&srv.gone, &srv.lock, &deadline) != ETIMEDOUT)
+      ;
+
+   /* a client still around isn't reading its answers; cutting it off makes
+    * its writing thread fail out of write_all instead of blocking there */
+   for (c = srv.clients; c; c = c->next)
+      shutdown(c->fd, SHUT_RDWR);
+   while (srv.clients)
+      pthread_cond_wait(&srv.gone, &srv.lock);
+
+   /* then let the workers go */
+   srv.quit = 1;
+   pthread_cond_broadcast(&srv.work);
+   pthread_mutex_unlock(&srv.lock);
+   for (j = 0; j < started; j++)
+      pthread_join(workers[j], NULL);
+
+   close(srv.fd);
+   unlink(path);
+   pthread_mutex_destroy(&srv.lock);
+   pthread_cond_destroy(&srv.work);
+   pthread_cond_destroy(&srv.room);
+   pthread_cond_destroy(&srv.gone);
+   free(workers);
+   return 0;
+}
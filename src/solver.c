@@ -27,26 +27,60 @@
  */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include "xmalloc.h"
 #include "matrix.h"
-#include "stack.h"
+#include "parallel.h"
+#include "solver.h"
 
-/* associated with rows in the DLX matrix, each row object represents a
- * unique possible value for an x-y coordinate on the Sudoku board */
-typedef struct row {
-   int x, y, val;
-} row;
+/* Grids are passed in and out as n*n cells of one byte each, in row-major
+ * order, so the cell in column x of row y is at y*n + x. Puzzles use 0 for
+ * an empty cell and 1 to n for a value, and solutions are written the same
+ * way into a buffer the caller provides, which may be the puzzle itself. */
 
-/* struct containing the DLX matrix and associated data */
-typedef struct solver {
+/* struct containing the DLX matrix and associated data; the matrix holds a
+ * row for every possible value of every cell, numbered (x*n + y)*n + val, and
+ * is reused for every puzzle of the same size */
+struct solver {
    int n, k, x_off, y_off, b_off;
-   stack *rows;
    matrix *m;
-} solver;
+   unsigned *rows; /* scratch list for the rows of a solution */
+   uint8_t *grid;  /* scratch grid for enumerated solutions */
 
-/* constructs a solver object */
+   /* presolve state: the value of each cell, indexed x*n + y, or -1 if it
+    * isn't known yet, and the values used in each row, column, and box */
+   int *val;
+   uint64_t *row_used, *col_used, *box_used;
+   int left;       /* number of cells presolve couldn't decide */
+
+   search_limits limits; /* when to give up on a puzzle */
+
+   /* where enumerated solutions are passed on to */
+   solution_visit visit;
+   void *ctx;
+};
+
+void add_val(solver *s, int x, int y, int val) {
+   const int b = s->k*(y/s->k) + (x/s->k); /* box number */
+
+   /* four constraints */
+   unsigned data[4];
+   data[0] = s->n*y + x;                /* one value per cell */
+   data[1] = s->x_off + (s->n*x + val); /* each value once per column */
+   data[2] = s->y_off + (s->n*y + val); /* each value once per row */
+   data[3] = s->b_off + (s->n*b + val); /* each value once per box */
+
+   /* insert the row into the matrix */
+   matrix_add_row(s->m, data, 4);
+}
+
+/* constructs a solver object for boards of order k; returns NULL if there
+ * isn't enough memory */
 solver *new_solver(int k) {
-   solver *s = xmalloc(sizeof(solver));
+   solver *s = malloc(sizeof(solver));
+
+   if (!s)
+      return NULL;
 
    /* determine the various offsets for values in the DLX matrix */
    const int n = k*k;
@@ -61,95 +95,373 @@ solver *new_solver(int k) {
    s->y_off = y_off;
    s->b_off = b_off;
 
-   /* allocate a stack to keep track of the objects we insert into the
-    * DLX matrix, so we can free them later */
-   s->rows = new_stack();
-
-   /* construct the actual DLX matrix */
+   /* construct the actual DLX matrix, tagging each column with the kind of
+    * constraint it represents */
    s->m = new_matrix(b_off+x_off);
+   s->rows = malloc((b_off+x_off)*sizeof(unsigned));
+   s->grid = malloc(n*n);
+   s->val = malloc(n*n*sizeof(int));
+   s->row_used = malloc(n*sizeof(uint64_t));
+   s->col_used = malloc(n*sizeof(uint64_t));
+   s->box_used = malloc(n*sizeof(uint64_t));
+   s->limits.nodes = 0;
+   s->limits.seconds = 0;
+
+   /* make room for every value as a possibility for every cell, at four
+    * nodes per possibility, so adding the rows can't fail */
+   if (!s->m || !s->rows || !s->grid || !s->val || !s->row_used ||
+         !s->col_used || !s->box_used ||
+         !matrix_reserve(s->m, n*n*n, 4*n*n*n)) {
+      free_solver(s);
+      return NULL;
+   }
+
+   int i, x, y;
+   for (i = 0; i < b_off+x_off; i++)
+      matrix_set_col_type(s->m, i, i/x_off);
+
+   /* insert the possibilities */
+   for (x = 0; x < n; x++)
+      for (y = 0; y < n; y++)
+         for (i = 0; i < n; i++)
+            add_val(s, x, y, i);
 
    return s;
 }
 
 /* frees a solver object */
 void free_solver(solver *s) {
-   /* free the matrix and all of the row objects we've added to it */
-   free_matrix(s->m);
-   while (stack_size(s->rows))
-      free(stack_pop(s->rows));
-
-   /* free the stack of row objects and the solver itself */
-   free_stack(s->rows);
+   if (s->m)
+      free_matrix(s->m);
+   free(s->rows);
+   free(s->grid);
+   free(s->val);
+   free(s->row_used);
+   free(s->col_used);
+   free(s->box_used);
    free(s);
 }
 
-void add_val(solver *s, int x, int y, int val) {
-   const int b = s->k*(y/s->k) + (x/s->k); /* box number */
+/* returns the effort counters for the last puzzle, or NULL if they aren't
+ * built in; a puzzle presolve finished has no search to count */
+search_stats *solver_stats(solver *s) {
+   return matrix_stats(s->m);
+}
 
-   /* four constraints */
-   int data[4];
-   data[0] = s->n*y + x;                /* one value per cell */
-   data[1] = s->x_off + (s->n*x + val); /* each value once per column */
-   data[2] = s->y_off + (s->n*y + val); /* each value once per row */
-   data[3] = s->b_off + (s->n*b + val); /* each value once per box */
+/* sets how long the solver's searches may run before giving up on a
+ * puzzle; NULL or zero limits mean it never gives up */
+void solver_set_limits(solver *s, const search_limits *limits) {
+   s->limits.nodes = limits ? limits->nodes : 0;
+   s->limits.seconds = limits ? limits->seconds : 0;
+}
 
-   /* construct a row object to identify what the DLX row represents */
-   row *r = xmalloc(sizeof(row));
+/* sets the column selection strategy used for the solver's puzzles */
+void solver_set_strategy(solver *s, pick_strategy strategy,
+      unsigned long seed) {
+   matrix_set_strategy(s->m, strategy, seed);
+}
+
+/* puts the rows of the solver's matrix in a random order, so that along
+ * with the random strategy, solving an empty grid gives a random solved
+ * grid; returns 0 if there isn't enough memory */
+int solver_shuffle(solver *s, unsigned long seed) {
+   return matrix_shuffle(s->m, seed);
+}
 
-   r->x = x;
-   r->y = y;
-   r->val = val;
+/* the candidates left for an undecided cell */
+uint64_t candidates(solver *s, int x, int y) {
+   const uint64_t all = s->n == 64 ? ~(uint64_t)0 : ((uint64_t)1 << s->n) - 1;
+   return all & ~(s->row_used[y] | s->col_used[x] |
+         s->box_used[s->k*(y/s->k) + x/s->k]);
+}
+
+/* decides a cell; returns 0 if the value is already used in the cell's row,
+ * column, or box */
+int decide(solver *s, int x, int y, int v) {
+   const uint64_t bit = (uint64_t)1 << v;
+   if (!(candidates(s, x, y) & bit))
+      return 0;
 
-   /* insert the row into the matrix, and add it to our stack so we can free
-    * it later */
-   matrix_add_row(s->m, r, data, 4);
-   stack_push(s->rows, r);
+   s->val[x*s->n + y] = v;
+   s->row_used[y] |= bit;
+   s->col_used[x] |= bit;
+   s->box_used[s->k*(y/s->k) + x/s->k] |= bit;
+   s->left--;
+   return 1;
 }
 
-/* converts a Sudoku grid to a DLX matrix, solves the DLX matrix, and converts
- * the result back into a Sudoku grid */
-int **solve(int k, int **vals) {
-   /* create a new solver object */
-   solver *s = new_solver(k);
+/* the number of the lowest set bit */
+int low_bit(uint64_t c) {
+   int v = 0;
+   while (!(c >> v & 1))
+      v++;
+   return v;
+}
+
+/* finds cell i of unit u, where units 0 to n-1 are rows, n to 2n-1 are
+ * columns, and 2n to 3n-1 are boxes */
+void unit_cell(solver *s, int u, int i, int *x, int *y) {
+   const int n = s->n, k = s->k;
+
+   if (u < n) {
+      *x = i;
+      *y = u;
+   } else if (u < 2*n) {
+      *x = u - n;
+      *y = i;
+   } else {
+      u -= 2*n;
+      *x = u%k*k + i%k;
+      *y = u/k*k + i/k;
+   }
+}
+
+/* deduces what it can about a grid before it goes anywhere near the DLX
+ * matrix: rejects givens that conflict in O(n^2), then fills naked singles
+ * (cells with one candidate left) and hidden singles (values with one cell
+ * left in some row, column, or box) until nothing changes. Returns 0 if the
+ * grid can't be solved. */
+int presolve(solver *s, const uint8_t *vals) {
    const int n = s->n;
+   int x, y, u, i, changed;
+
+   matrix_clear_stats(s->m);
+   s->left = n*n;
+   for (i = 0; i < n; i++)
+      s->row_used[i] = s->col_used[i] = s->box_used[i] = 0;
 
-   /* insert all the input values into the solver */
-   int x, y, i;
-   for (x = 0; x < n; x++) {
-      for (y = 0; y < n; y++) {
-         /* if we have a specified value, insert it as a single possibility;
-          * otherwise, insert each value as a possibility for that cell */
-         if (0 < vals[x][y] && vals[x][y] <= n)
-            add_val(s, x, y, vals[x][y] - 1);
-         else
-            for (i = 0; i < n; i++)
-               add_val(s, x, y, i);
+   /* place the givens */
+   for (i = 0; i < n*n; i++)
+      s->val[i] = -1;
+   for (y = 0; y < n; y++) {
+      for (x = 0; x < n; x++) {
+         const int v = vals[y*n + x];
+         if (0 < v && v <= n && !decide(s, x, y, v - 1))
+            return 0;
       }
    }
 
-   /* retrieve the solution */
-   int len;
-   row **result = (row**)matrix_solve(s->m, &len);
-   int **solution = NULL;
-
-   /* check if the solver was successful */
-   if (result) {
-      /* we were successful, allocate a solution grid */
-      solution = xmalloc(n*sizeof(int*));
-      for (i = 0; i < n; i++)
-         solution[i] = xmalloc(n*sizeof(int));
-
-      /* insert the values into the solution grid */
-      for (i = 0; i < len; i++) {
-         /* each row object contains the x-y coordinates and value of a cell */
-         row *r = result[i];
-         solution[r->x][r->y] = r->val;
+   do {
+      changed = 0;
+
+      /* naked singles */
+      for (x = 0; x < n; x++) {
+         for (y = 0; y < n; y++) {
+            if (s->val[x*n + y] >= 0)
+               continue;
+
+            const uint64_t c = candidates(s, x, y);
+            if (!c)
+               return 0;
+            if (!(c & (c - 1)))
+               changed |= decide(s, x, y, low_bit(c));
+         }
+      }
+
+      /* hidden singles */
+      for (u = 0; u < 3*n; u++) {
+         uint64_t once = 0, twice = 0, placed = 0;
+
+         for (i = 0; i < n; i++) {
+            unit_cell(s, u, i, &x, &y);
+            if (s->val[x*n + y] >= 0) {
+               placed |= (uint64_t)1 << s->val[x*n + y];
+            } else {
+               const uint64_t c = candidates(s, x, y);
+               twice |= once & c;
+               once |= c;
+            }
+         }
+
+         /* a value with nowhere to go means there's no solution */
+         if ((once | placed) != (n == 64 ? ~(uint64_t)0
+                                         : ((uint64_t)1 << n) - 1))
+            return 0;
+
+         /* fill the first hidden single; the unit is looked at again on the
+          * next pass */
+         once &= ~twice;
+         if (once) {
+            const int v = low_bit(once);
+            for (i = 0; ; i++) {
+               unit_cell(s, u, i, &x, &y);
+               if (s->val[x*n + y] < 0 && (candidates(s, x, y) >> v & 1))
+                  break;
+            }
+            changed |= decide(s, x, y, v);
+         }
       }
+   } while (changed && s->left);
+
+   return 1;
+}
+
+/* presolves a grid, and selects the row of every cell it decided in the DLX
+ * matrix, so that only the surviving candidates are left for the search;
+ * returns 0 if the grid can't be solved */
+int select_givens(solver *s, const uint8_t *vals) {
+   const int n = s->n;
+   int i;
+
+   if (!presolve(s, vals))
+      return 0;
+
+   /* a grid finished by presolve doesn't need the matrix at all */
+   if (!s->left)
+      return 1;
+
+   for (i = 0; i < n*n; i++)
+      if (s->val[i] >= 0 && !matrix_select_row(s->m, i*n + s->val[i]))
+         return 0;
+
+   return 1;
+}
+
+/* inserts the values presolve decided into a grid */
+void fill_decided(solver *s, uint8_t *grid) {
+   const int n = s->n;
+   int i;
+
+   for (i = 0; i < n*n; i++)
+      grid[i%n*n + i/n] = s->val[i] + 1;
+}
+
+/* inserts the values of a solution into a grid; the row number encodes the
+ * x-y coordinates and value of a cell */
+void fill_grid(solver *s, const unsigned *rows, int len, uint8_t *grid) {
+   const int n = s->n;
+   int i;
+
+   for (i = 0; i < len; i++)
+      grid[rows[i]/n%n*n + rows[i]/n/n] = rows[i]%n + 1;
+}
+
+/* passes a solution found by matrix_enumerate on as a Sudoku grid */
+int visit_rows(void *ctx, const unsigned *rows, int len) {
+   solver *s = ctx;
+   fill_grid(s, rows, len, s->grid);
+   return s->visit(s->ctx, s->grid);
+}
+
+/* solves a Sudoku grid by selecting the rows for its given values in the
+ * DLX matrix, solving the DLX matrix, and writing the result into out;
+ * out is left alone unless the result is SOLVE_FOUND. The search gives up
+ * if it runs past the solver's limits. The matrix is restored afterwards
+ * for the next puzzle. */
+solve_status solver_solve(solver *s, const uint8_t *vals, uint8_t *out) {
+   return solver_solve_split(s, vals, out, 1);
+}
+
+/* solves a Sudoku grid like solver_solve, but splits the search between
+ * jobs threads */
+solve_status solver_solve_split(solver *s, const uint8_t *vals, uint8_t *out,
+      int jobs) {
+   int len = -1;
+
+   /* retrieve the solution, unless presolve finished the grid or found it
+    * can't be solved */
+   if (select_givens(s, vals))
+      len = !s->left ? 0
+          : jobs > 1 ? matrix_solve_parallel(s->m, jobs, s->rows, &s->limits)
+                     : matrix_solve(s->m, s->rows, &s->limits);
+
+   /* write the solution out if the solver was successful */
+   if (len >= 0) {
+      if (s->left)
+         fill_grid(s, s->rows, len, out);
+      else
+         fill_decided(s, out);
    }
 
-   /* free the list of row objects and the solver objects */
-   free(result);
+   /* put the matrix back the way we found it */
+   matrix_reset(s->m);
+
+   return len >= 0 ? SOLVE_FOUND
+        : len == MATRIX_GAVE_UP ? SOLVE_GAVE_UP : SOLVE_NONE;
+}
+
+/* selects the row for value v (0 to n-1) of the cell in column x of row y
+ * ahead of any search, leaving it selected until solver_unselect; returns 0
+ * if the value clashes with one already selected. Selected rows are kept
+ * apart from solver_solve's puzzles, so a solver used this way should only
+ * be searched with solver_search. */
+int solver_select(solver *s, int x, int y, int v) {
+   return matrix_select_row(s->m, (x*s->n + y)*s->n + v);
+}
+
+/* undoes the most recent solver_select */
+void solver_unselect(solver *s) {
+   matrix_unselect_row(s->m);
+}
+
+/* searches for a way to complete the rows selected so far, within the
+ * solver's limits, and writes the whole grid into out if it finds one; the
+ * selected rows are left as they were */
+solve_status solver_search(solver *s, uint8_t *out) {
+   const int len = matrix_solve(s->m, s->rows, &s->limits);
+
+   if (len >= 0)
+      fill_grid(s, s->rows, len, out);
+   return len >= 0 ? SOLVE_FOUND
+        : len == MATRIX_GAVE_UP ? SOLVE_GAVE_UP : SOLVE_NONE;
+}
+
+/* looks for a cell the rows selected so far force a value on, because it
+ * has one value left or a value has one place left in some row, column, or
+ * box; stores its column, row and value (0 to n-1). Returns 1 if there is
+ * one, 0 if nothing is forced, and -1 if some cell or value has no place
+ * left at all, or -2 if every cell is selected. */
+int solver_forced(solver *s, int *x, int *y, int *v) {
+   const int n = s->n;
+   const int len = matrix_branches(s->m, s->rows);
+
+   if (len < 0)
+      return -2;
+   if (len != 1)
+      return len ? 0 : -1;
+
+   *x = s->rows[0]/n/n;
+   *y = s->rows[0]/n%n;
+   *v = s->rows[0]%n;
+   return 1;
+}
+
+/* converts a Sudoku grid to a DLX matrix, solves the DLX matrix within the
+ * limits (which may be NULL), and writes the result into out */
+solve_status solve(int k, const uint8_t *vals, uint8_t *out,
+      const search_limits *limits) {
+   solver *s = xcheck(new_solver(k));
+   solver_set_limits(s, limits);
+   const solve_status st = solver_solve(s, vals, out);
    free_solver(s);
+   return st;
+}
+
+/* finds up to limit solutions of a Sudoku grid (0 means no limit), handing
+ * each to visit along with ctx as it is found; visit may be NULL to just
+ * count, and can return nonzero to stop early. The grid passed to visit is
+ * only valid during the call. Returns the number of solutions found, so a
+ * limit of 2 is enough to tell whether a puzzle is uniquely solvable. */
+unsigned long solver_enumerate(solver *s, const uint8_t *vals,
+      unsigned long limit, solution_visit visit, void *ctx) {
+   unsigned long count = 0;
+
+   s->visit = visit;
+   s->ctx = ctx;
+
+   if (select_givens(s, vals)) {
+      if (s->left) {
+         count = matrix_enumerate(s->m, limit, visit ? visit_rows : NULL, s);
+      } else {
+         /* presolve finished the grid, so it's the only solution */
+         count = 1;
+         if (visit) {
+            fill_decided(s, s->grid);
+            visit(ctx, s->grid);
+         }
+      }
+   }
 
-   return solution;
+   matrix_reset(s->m);
+   return count;
 }
@@ -29,6 +29,38 @@
 #ifndef SOLVER_H_GUARD
 #define SOLVER_H_GUARD
 
-int **solve(int k, int **vals);
+#include <stdint.h>
+#include "matrix.h"
+
+typedef struct solver solver;
+
+/* outcomes of solving a puzzle */
+typedef enum solve_status {
+   SOLVE_NONE,   /* the puzzle has no solution */
+   SOLVE_FOUND,  /* the solution was written out */
+   SOLVE_GAVE_UP /* the search ran past its limits */
+} solve_status;
+
+/* receives each solution found by solver_enumerate; returns nonzero to stop */
+typedef int (*solution_visit)(void *ctx, const uint8_t *grid);
+
+solver *new_solver(int k);
+void free_solver(solver *s);
+void solver_set_strategy(solver *s, pick_strategy strategy,
+      unsigned long seed);
+int solver_shuffle(solver *s, unsigned long seed);
+search_stats *solver_stats(solver *s);
+void solver_set_limits(solver *s, const search_limits *limits);
+solve_status solver_solve(solver *s, const uint8_t *vals, uint8_t *out);
+solve_status solver_solve_split(solver *s, const uint8_t *vals, uint8_t *out,
+      int jobs);
+unsigned long solver_enumerate(solver *s, const uint8_t *vals,
+      unsigned long limit, solution_visit visit, void *ctx);
+int solver_select(solver *s, int x, int y, int v);
+void solver_unselect(solver *s);
+solve_status solver_search(solver *s, uint8_t *out);
+int solver_forced(solver *s, int *x, int *y, int *v);
+solve_status solve(int k, const uint8_t *vals, uint8_t *out,
+      const search_limits *limits);
 
 #endif
@@ -28,6 +28,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include "xmalloc.h"
 
 /* "safe" malloc, exits with an error if allocation fails */
 void *xmalloc(size_t sz) {
@@ -39,6 +40,16 @@ void *xmalloc(size_t sz) {
    return data;
 }
 
+/* exits with an error if an allocation made some other way failed, and
+ * otherwise passes it through */
+void *xcheck(void *data) {
+   if (!data) {
+      fprintf(stderr, "out of memory, exiting\n");
+      exit(1);
+   }
+   return data;
+}
+
 /* "safe" realloc, exits with an error if allocation fails */
 void *xrealloc(void *old, size_t sz) {
    void *new = NULL;
@@ -29,7 +29,10 @@
 #ifndef XMALLOC_H_GUARD
 #define XMALLOC_H_GUARD
 
+#include <stddef.h>
+
 void *xrealloc(void *old, size_t sz);
 void *xmalloc(size_t sz);
+void *xcheck(void *data);
 
 #endif